@@ -0,0 +1,572 @@
+// buffercache.cc
+//	Routines of the kernel cache of disk sectors.  See buffercache.h.
+//
+//	The lock is released around every disk transfer, so that other
+//	threads can use the cache meanwhile; the buffer being transferred
+//	is marked busy instead.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifdef CHANGED
+
+#include "copyright.h"
+#include "system.h"
+#include "buffercache.h"
+#ifdef USER_PROGRAM
+#include "userthread.h"
+#endif
+
+#include <strings.h>		/* for bcopy, bcmp */
+
+//----------------------------------------------------------------------
+// BufferCache::BufferCache
+// 	Initially, the buffers hold no sector; they are all in the LRU
+//	list, in index order.
+//----------------------------------------------------------------------
+
+BufferCache::BufferCache()
+{
+    for (int b = 0; b < NumBuffers; b++) {
+	buffers[b].sector = -1;
+	buffers[b].dirty = FALSE;
+	buffers[b].busy = FALSE;
+	buffers[b].logged = FALSE;
+	buffers[b].lruPrev = b - 1;
+	buffers[b].lruNext = b + 1 < NumBuffers ? b + 1 : -1;
+    }
+    lruHead = 0;
+    lruTail = NumBuffers - 1;
+    for (int i = 0; i < BufferBuckets; i++)
+	bucket[i] = -1;
+    lock = new Lock("buffer cache lock");
+    notBusy = new Condition("buffer not busy");
+    alarmArmed = FALSE;
+    flushing = FALSE;
+    flusherStopped = FALSE;
+    flushRequest = new Semaphore("buffer flush request", 0);
+    prefetchQueue = new List;
+    numPrefetches = 0;
+    prefetchRequest = new Semaphore("prefetch request", 0);
+}
+
+BufferCache::~BufferCache()
+{
+    delete lock;
+    delete notBusy;
+    delete flushRequest;
+    delete prefetchQueue;
+    delete prefetchRequest;
+}
+
+//----------------------------------------------------------------------
+// BufferCache::ReadSector
+// 	Copy "sector" into "data", reading it from disk on a miss.
+//----------------------------------------------------------------------
+
+void
+BufferCache::ReadSector(int sector, char *data)
+{
+    lock->Acquire();
+    int b = GetBuffer(sector, TRUE);
+    bcopy(buffers[b].data, data, SectorSize);
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// BufferCache::WriteSector
+// 	Copy "data" into the buffer of "sector".  The whole sector is
+//	overwritten, so a miss does not need to read it first.
+//----------------------------------------------------------------------
+
+void
+BufferCache::WriteSector(int sector, char *data)
+{
+    lock->Acquire();
+    Store(sector, data);
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// BufferCache::ReadSectors
+// 	Copy the "count" sectors from "sector" on into "data".  Each run of
+//	sectors that are not cached is read with a single disk request,
+//	into clean buffers taken for them.
+//----------------------------------------------------------------------
+
+void
+BufferCache::ReadSectors(int sector, int count, char *data)
+{
+    int claimed[MaxBatch];
+    char *buffersData[MaxBatch];
+    int i = 0, n, k, b;
+
+    lock->Acquire();
+    while (i < count) {
+	for (n = 0; i + n < count && n < MaxBatch
+		 && Lookup(sector + i + n) < 0; n++) {
+	    b = CleanVictim();
+	    if (b < 0)
+		break;
+	    stats->numBufferMisses++;
+	    if (buffers[b].sector >= 0)
+		HashRemove(b);
+	    buffers[b].sector = sector + i + n;
+	    HashInsert(b);
+	    MakeMostRecent(b);
+	    buffers[b].busy = TRUE;	// others wait for the transfer
+	    claimed[n] = b;
+	    buffersData[n] = buffers[b].data;
+	}
+	if (n == 0) {			// cached, or only dirty buffers left
+	    b = GetBuffer(sector + i, TRUE);
+	    bcopy(buffers[b].data, &data[i * SectorSize], SectorSize);
+	    i++;
+	    continue;
+	}
+	lock->Release();
+	synchDisk->ReadSectors(sector + i, n, buffersData);
+	lock->Acquire();
+	for (k = 0; k < n; k++) {
+	    buffers[claimed[k]].busy = FALSE;
+	    bcopy(buffers[claimed[k]].data, &data[(i + k) * SectorSize],
+		  SectorSize);
+	}
+	notBusy->Broadcast(lock);
+	i += n;
+    }
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// BufferCache::WriteSectors
+// 	Copy "data" into the buffers of the "count" sectors from "sector"
+//	on.  The flush writes them back together.
+//----------------------------------------------------------------------
+
+void
+BufferCache::WriteSectors(int sector, int count, char *data)
+{
+    lock->Acquire();
+    for (int i = 0; i < count; i++)
+	Store(sector + i, &data[i * SectorSize]);
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// BufferCache::Store
+// 	Copy "data" into the buffer of "sector".  Inside a file system
+//	operation, the buffer is logged, unless "data" is what the sector
+//	holds already: the sector is then read first on a miss, since a
+//	directory or the free sector map is written back whole, but
+//	changes in one sector or two.
+//----------------------------------------------------------------------
+
+void
+BufferCache::Store(int sector, char *data)
+{
+    bool journaled = Journal::InOperation();
+    int b = GetBuffer(sector, journaled);
+
+    if (journaled && bcmp(data, buffers[b].data, SectorSize) == 0)
+	return;
+    bcopy(data, buffers[b].data, SectorSize);
+    MarkDirty(b);
+    if (journaled)
+	buffers[b].logged = TRUE;
+}
+
+//----------------------------------------------------------------------
+// BufferCache::GetBuffer
+// 	Find the buffer of "sector", or give it the least recently used
+//	buffer that is not busy, writing that one back first if it is
+//	dirty.  Since the lock is released during the transfers, the
+//	search starts again after each of them.
+//----------------------------------------------------------------------
+
+int
+BufferCache::GetBuffer(int sector, bool fill)
+{
+    for (;;) {
+	int b = Lookup(sector);
+	if (b >= 0) {
+	    if (buffers[b].busy) {
+		notBusy->Wait(lock);
+		continue;
+	    }
+	    stats->numBufferHits++;
+	    MakeMostRecent(b);
+	    return b;
+	}
+
+	for (b = lruTail; b >= 0 && (buffers[b].busy || buffers[b].logged);
+	     b = buffers[b].lruPrev)
+	    continue;
+	if (b < 0) {			// all in transfer, or logged
+	    notBusy->Wait(lock);
+	    continue;
+	}
+	Buffer *buf = &buffers[b];
+	if (buf->dirty) {
+	    buf->busy = TRUE;
+	    lock->Release();
+	    synchDisk->WriteSector(buf->sector, buf->data);
+	    lock->Acquire();
+	    buf->dirty = FALSE;
+	    buf->busy = FALSE;
+	    notBusy->Broadcast(lock);
+	    continue;
+	}
+
+	stats->numBufferMisses++;
+	if (buf->sector >= 0)
+	    HashRemove(b);
+	buf->sector = sector;
+	HashInsert(b);
+	MakeMostRecent(b);
+	if (fill) {
+	    buf->busy = TRUE;
+	    lock->Release();
+	    synchDisk->ReadSector(sector, buf->data);
+	    lock->Acquire();
+	    buf->busy = FALSE;
+	    notBusy->Broadcast(lock);
+	}
+	return b;
+    }
+}
+
+//----------------------------------------------------------------------
+// BufferCache::Flush
+// 	Write every dirty buffer back to disk.  Called periodically by
+//	the flusher thread, and by Cleanup before the disk goes away.
+//	A dirty buffer is written together with the dirty buffers of the
+//	sectors around it, in a single disk request.
+//----------------------------------------------------------------------
+
+void
+BufferCache::Flush()
+{
+    int batch[MaxBatch];
+    char *buffersData[MaxBatch];
+    int first, n, k;
+
+    lock->Acquire();
+    for (int b = 0; b < NumBuffers; b++) {
+	while (buffers[b].busy)
+	    notBusy->Wait(lock);
+	if (!buffers[b].dirty || buffers[b].logged)
+	    continue;
+	for (first = buffers[b].sector;
+	     first > buffers[b].sector - (MaxBatch - 1) && first > 0
+		 && Flushable(first - 1) >= 0; first--)
+	    ;
+	for (n = 0; n < MaxBatch && first + n < NumSectors
+		 && (batch[n] = Flushable(first + n)) >= 0; n++) {
+	    buffers[batch[n]].busy = TRUE;
+	    buffersData[n] = buffers[batch[n]].data;
+	}
+	lock->Release();
+	synchDisk->WriteSectors(first, n, buffersData);
+	lock->Acquire();
+	for (k = 0; k < n; k++) {
+	    buffers[batch[k]].dirty = FALSE;
+	    buffers[batch[k]].busy = FALSE;
+	}
+	notBusy->Broadcast(lock);
+    }
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// BufferCache::CollectLogged
+// 	Copy the sector numbers and the contents of the logged buffers
+//	into "sectors" and "data", for the journal to commit them, and
+//	return how many there are.  No operation is in progress, so they
+//	cannot change until ReleaseLogged.
+//----------------------------------------------------------------------
+
+int
+BufferCache::CollectLogged(int *sectors, char **data, int max)
+{
+    int n = 0;
+
+    lock->Acquire();
+    for (int b = 0; b < NumBuffers; b++)
+	if (buffers[b].logged) {
+	    ASSERT(n < max);		// an operation reserved too little
+	    sectors[n] = buffers[b].sector;
+	    bcopy(buffers[b].data, data[n], SectorSize);
+	    n++;
+	}
+    lock->Release();
+    return n;
+}
+
+//----------------------------------------------------------------------
+// BufferCache::ReleaseLogged
+// 	The logged buffers are committed: they are now dirty buffers
+//	like the others.
+//----------------------------------------------------------------------
+
+void
+BufferCache::ReleaseLogged()
+{
+    lock->Acquire();
+    for (int b = 0; b < NumBuffers; b++)
+	buffers[b].logged = FALSE;
+    notBusy->Broadcast(lock);		// they can be replaced again
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// BufferCache::Invalidate
+// 	Write back the dirty buffers, and empty the cache, so that a
+//	benchmark can measure accesses that miss.  A buffer dirtied again
+//	in the meantime is kept.
+//----------------------------------------------------------------------
+
+void
+BufferCache::Invalidate()
+{
+    Flush();
+    lock->Acquire();
+    for (int b = 0; b < NumBuffers; b++) {
+	while (buffers[b].busy)
+	    notBusy->Wait(lock);
+	if (buffers[b].sector >= 0 && !buffers[b].dirty) {
+	    HashRemove(b);
+	    buffers[b].sector = -1;
+	}
+    }
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// Periodic flushes
+// 	The first buffer made dirty after a flush arms the alarm.  When
+//	it goes off, the interrupt handler cannot block on the disk, so
+//	it wakes up the flusher thread to do the writing.
+//----------------------------------------------------------------------
+
+static void
+FlushAlarmHandler(int arg)
+{
+    ((BufferCache *) arg)->FlushAlarm();
+}
+
+static void
+FlusherThread(int dummy)
+{
+    bufferCache->FlusherLoop();
+}
+
+static void
+PrefetcherThread(int dummy)
+{
+    bufferCache->PrefetcherLoop();
+}
+
+static void
+ForkKernelThread(const char *name, VoidFunctionPtr func)
+{
+    Thread *thread = new Thread(name);
+#ifdef USER_PROGRAM
+    // Thread::Fork expects a ThreadParam; there is no address space
+    ThreadParam *threadParam = new ThreadParam();
+    threadParam->isProcess = true;
+    thread->Fork(func, (int) threadParam);
+#else
+    thread->Fork(func, 0);
+#endif
+}
+
+void
+BufferCache::MarkDirty(int b)
+{
+    buffers[b].dirty = TRUE;
+    ArmFlushAlarm();
+}
+
+void
+BufferCache::ArmFlushAlarm()
+{
+    if (!alarmArmed) {
+	alarmArmed = TRUE;
+	interrupt->Schedule(FlushAlarmHandler, (int) this, FlushDelay, TimerInt);
+    }
+}
+
+void
+BufferCache::ScheduleFlush()
+{
+    lock->Acquire();
+    ArmFlushAlarm();
+    lock->Release();
+}
+
+void
+BufferCache::FlushAlarm()
+{
+    flushRequest->V();
+}
+
+void
+BufferCache::StartThreads()
+{
+    ForkKernelThread("buffer flusher", FlusherThread);
+    ForkKernelThread("buffer prefetcher", PrefetcherThread);
+}
+
+void
+BufferCache::FlusherLoop()
+{
+    for (;;) {
+	flushRequest->P();
+	lock->Acquire();
+	alarmArmed = FALSE;	// buffers dirtied from now on rearm it
+	flushing = !flusherStopped;
+	lock->Release();
+	if (!flushing)
+	    continue;		// Cleanup flushes, from now on
+	DEBUG('f', "Flushing the buffer cache\n");
+	if (fileSystem != NULL)		// not while it is being mounted
+	    journal->Checkpoint();	// commits the free map, first
+	else
+	    Flush();
+	lock->Acquire();
+	flushing = FALSE;
+	notBusy->Broadcast(lock);	// for StopFlusher
+	lock->Release();
+    }
+}
+
+//----------------------------------------------------------------------
+// BufferCache::StopFlusher
+// 	Called by Cleanup before the file system and the journal are
+//	deleted: a flush alarm going off later must not checkpoint them.
+//	A checkpoint in progress is over when StopFlusher returns.
+//----------------------------------------------------------------------
+
+void
+BufferCache::StopFlusher()
+{
+    lock->Acquire();
+    flusherStopped = TRUE;
+    while (flushing)
+	notBusy->Wait(lock);
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// BufferCache::Prefetch
+// 	Queue "sector" for the prefetcher, unless it is cached already.
+//	When too many prefetches are pending, the disk is not keeping up
+//	and more would only push useful sectors out: drop the request.
+//----------------------------------------------------------------------
+
+void
+BufferCache::Prefetch(int sector)
+{
+    if (sector < 0)
+	return;
+    lock->Acquire();
+    if (Lookup(sector) < 0 && numPrefetches < MaxPrefetches) {
+	prefetchQueue->Append((void *) sector);
+	numPrefetches++;
+	prefetchRequest->V();
+    }
+    lock->Release();
+}
+
+void
+BufferCache::PrefetcherLoop()
+{
+    for (;;) {
+	prefetchRequest->P();
+	lock->Acquire();
+	int sector = (int) prefetchQueue->Remove();
+	numPrefetches--;
+	if (Lookup(sector) < 0) {
+	    DEBUG('f', "Prefetching sector %d\n", sector);
+	    stats->numReadAheads++;
+	    GetBuffer(sector, TRUE);
+	}
+	lock->Release();
+    }
+}
+
+//----------------------------------------------------------------------
+// Hash table and LRU list maintenance.  Lock held.
+//----------------------------------------------------------------------
+
+int
+BufferCache::CleanVictim()
+{
+    int b;
+
+    for (b = lruTail; b >= 0 && (buffers[b].busy || buffers[b].dirty);
+	 b = buffers[b].lruPrev)
+	continue;
+    return b;
+}
+
+int
+BufferCache::Flushable(int sector)
+{
+    int b = Lookup(sector);
+
+    if (b >= 0 && buffers[b].dirty && !buffers[b].busy && !buffers[b].logged)
+	return b;
+    return -1;
+}
+
+int
+BufferCache::Lookup(int sector)
+{
+    int b = bucket[sector % BufferBuckets];
+
+    while (b >= 0 && buffers[b].sector != sector)
+	b = buffers[b].hashNext;
+    return b;
+}
+
+void
+BufferCache::HashInsert(int b)
+{
+    int h = buffers[b].sector % BufferBuckets;
+
+    buffers[b].hashNext = bucket[h];
+    bucket[h] = b;
+}
+
+void
+BufferCache::HashRemove(int b)
+{
+    int *link = &bucket[buffers[b].sector % BufferBuckets];
+
+    while (*link != b)
+	link = &buffers[*link].hashNext;
+    *link = buffers[b].hashNext;
+}
+
+void
+BufferCache::MakeMostRecent(int b)
+{
+    if (b == lruHead)
+	return;
+    // unlink
+    buffers[buffers[b].lruPrev].lruNext = buffers[b].lruNext;
+    if (b == lruTail)
+	lruTail = buffers[b].lruPrev;
+    else
+	buffers[buffers[b].lruNext].lruPrev = buffers[b].lruPrev;
+    // put in front
+    buffers[b].lruPrev = -1;
+    buffers[b].lruNext = lruHead;
+    buffers[lruHead].lruPrev = b;
+    lruHead = b;
+}
+
+#endif // CHANGED
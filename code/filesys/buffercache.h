@@ -0,0 +1,140 @@
+// buffercache.h
+//	Data structures for the kernel cache of disk sectors.
+//
+//	The buffer cache sits in front of the SynchDisk: the file system
+//	reads and writes sectors through it, and only the sectors it
+//	does not hold cost a disk access.  It keeps NumBuffers sectors,
+//	found through a hash table, and replaces the least recently used
+//	one when it needs room.
+//
+//	Writes are write-back: a written buffer is only marked dirty.
+//	Dirty buffers go to disk when they are replaced, when the cache
+//	is flushed at shutdown, and periodically: the first buffer made
+//	dirty arms an alarm, FlushDelay ticks later, which wakes up a
+//	flusher thread.  No alarm is pending while the cache is clean,
+//	so an idle Nachos still halts.
+//
+//	Sectors written by a file system operation (see journal.h) are
+//	logged: their buffer stays in the cache, and no flush writes it,
+//	until the journal has committed it.  A logged write that does
+//	not change the sector is dropped, so that only the sectors really
+//	changed go to the log.
+//
+//	A buffer being read or written by the disk is busy: threads
+//	wanting it wait on a condition until the transfer is over.
+//
+//	Runs of consecutive sectors missing from the cache are read with a
+//	single disk request, straight into the buffers that will hold
+//	them, and a flush writes dirty buffers of consecutive sectors
+//	together.
+//
+//	Sectors can also be prefetched: Prefetch only queues the sector,
+//	and a prefetcher thread reads it into the cache later, so that
+//	the disk works while the thread that asked goes on.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifdef CHANGED
+
+#ifndef BUFFERCACHE_H
+#define BUFFERCACHE_H
+
+#include "copyright.h"
+#include "disk.h"
+#include "synch.h"
+#include "list.h"
+
+#define NumBuffers	64		// sectors held by the cache
+#define BufferBuckets	31		// size of the hash table
+#define FlushDelay	100000		// ticks before dirty buffers are
+					// written back
+#define MaxPrefetches	(NumBuffers / 4)	// prefetches queued at most
+#define MaxBatch	(NumBuffers / 4)	// sectors in a disk request
+
+class Buffer {
+  public:
+    int sector;			// sector held, or -1
+    bool dirty;			// modified since read from disk?
+    bool busy;			// being transferred to or from disk?
+    bool logged;		// written by an operation not committed
+				// yet?
+    int hashNext;		// next buffer in the same hash chain
+    int lruPrev, lruNext;	// neighbours in the LRU list
+    char data[SectorSize];
+};
+
+class BufferCache {
+  public:
+    BufferCache();
+    ~BufferCache();
+
+    void ReadSector(int sector, char *data);
+				// Same as SynchDisk::ReadSector, but from
+				// the cache if possible
+    void WriteSector(int sector, char *data);
+				// Same as SynchDisk::WriteSector, but
+				// only into the cache
+    void ReadSectors(int sector, int count, char *data);
+    void WriteSectors(int sector, int count, char *data);
+				// Same for "count" consecutive sectors,
+				// from "sector" on
+    void Flush();		// Write all the dirty buffers to disk
+    void Invalidate();		// Flush, then forget every sector, so
+				// that the next accesses go to disk
+				// (for benchmarks)
+    void ScheduleFlush();	// Make sure a periodic flush will happen,
+				// for data written back lazily by its
+				// owner (the free sector map)
+    void Prefetch(int sector);	// Read "sector" in the background, if
+				// it is not cached
+    int CollectLogged(int *sectors, char **data, int max);
+				// Copy the logged buffers, at most
+				// "max", and return how many there are
+    void ReleaseLogged();	// They are committed: let them be
+				// written home
+
+    void StartThreads();	// Fork the flusher and the prefetcher
+    void StopFlusher();		// Wait for the flusher to be idle, and
+				// keep it so (the file system is going
+				// away)
+    void FlusherLoop();		// Body of the flusher thread
+    void FlushAlarm();		// Called by the alarm interrupt
+    void PrefetcherLoop();	// Body of the prefetcher thread
+
+  private:
+    int Lookup(int sector);	// buffer holding "sector", or -1
+    void HashInsert(int b);
+    void HashRemove(int b);
+    void MakeMostRecent(int b);	// move "b" to the head of the LRU list
+    int GetBuffer(int sector, bool fill);
+				// Return the buffer holding "sector",
+				// reading it first if "fill"; lock held
+    void Store(int sector, char *data);
+				// Write "data" into the buffer of
+				// "sector", logged if need be; lock held
+    void MarkDirty(int b);
+    int CleanVictim();		// least recently used buffer neither
+				// busy nor dirty, or -1
+    int Flushable(int sector);	// buffer of "sector" if it is dirty
+				// and not busy, -1 otherwise
+    void ArmFlushAlarm();	// lock held
+
+    Buffer buffers[NumBuffers];
+    int bucket[BufferBuckets];	// first buffer of each hash chain
+    int lruHead, lruTail;	// most and least recently used buffers
+    Lock *lock;			// protects everything above
+    Condition *notBusy;		// signaled when a transfer completes
+    bool alarmArmed;		// is a periodic flush scheduled?
+    bool flushing;		// is the flusher at work?
+    bool flusherStopped;	// has StopFlusher been called?
+    Semaphore *flushRequest;	// wakes up the flusher thread
+    List *prefetchQueue;	// sectors to prefetch
+    int numPrefetches;		// length of prefetchQueue
+    Semaphore *prefetchRequest;	// counts the sectors queued
+};
+
+#endif // BUFFERCACHE_H
+
+#endif // CHANGED
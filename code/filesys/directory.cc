@@ -16,6 +16,11 @@
 //	entries in the directory are used, no more files can be created.
 //	Fixing this is one of the parts to the assignment.
 //
+//	Hashed directories (see directory.h) grow up to the largest file
+//	size, and are read a bucket at a time, when a lookup needs it:
+//	FetchFrom only reads the header sector, and WriteBack only writes
+//	the sectors changed.
+//
 // Copyright (c) 1992-1993 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation 
 // of liability and disclaimer of warranty provisions.
@@ -27,6 +32,9 @@
 #include "filesys.h"
 #include <libgen.h>
 #include <string>
+#ifdef CHANGED
+#include <strings.h>		/* for bzero */
+#endif
 
 
 //----------------------------------------------------------------------
@@ -48,6 +56,22 @@ Directory::Directory(int size)
 	table[i].inUse = FALSE;
     table[i].isFile=TRUE;
     }
+#ifdef CHANGED
+    hashed = TRUE;			// written in the hashed format
+    file = NULL;
+    header.magic = DirectoryMagic;
+    header.numSectors = 1;
+    header.numBuckets = 1;
+    header.numEntries = 0;
+    for (int b = 0; b < DirectBuckets; b++)
+	header.direct[b] = 0;
+    for (int t = 0; t < (int) NumTables; t++)
+	header.tables[t] = 0;
+    headerDirty = TRUE;
+    sectors = NULL;
+    dirty = NULL;
+    numLoaded = 0;
+#endif
 }
 
 //----------------------------------------------------------------------
@@ -58,6 +82,13 @@ Directory::Directory(int size)
 Directory::~Directory()
 { 
     delete [] table;
+#ifdef CHANGED
+    for (int s = 0; s < numLoaded; s++)
+	delete [] sectors[s];
+    delete [] sectors;
+    delete [] dirty;
+    delete file;
+#endif
 } 
 
 //----------------------------------------------------------------------
@@ -67,24 +98,83 @@ Directory::~Directory()
 //	"file" -- file containing the directory contents
 //----------------------------------------------------------------------
 
+#ifndef CHANGED
 void
 Directory::FetchFrom(OpenFile *file)
 {
     (void) file->ReadAt((char *)table, tableSize * sizeof(DirectoryEntry), 0);
 }
+#else
+void
+Directory::FetchFrom(OpenFile *dirFile)
+{
+    for (int s = 0; s < numLoaded; s++)	// forget what was there
+	delete [] sectors[s];
+    numLoaded = 0;
+    delete file;
+    file = NULL;
+    hashed = TRUE;
+    if (dirFile->ReadAt((char *) &header, SectorSize, 0) == SectorSize
+	&& header.magic == DirectoryMagic) {
+	// The caller may close "dirFile" before the buckets are read
+	file = new OpenFile(dirFile->fileSector());
+	headerDirty = FALSE;
+    } else {
+	hashed = FALSE;
+	(void) dirFile->ReadAt((char *)table,
+			       tableSize * sizeof(DirectoryEntry), 0);
+    }
+}
+#endif
 
 //----------------------------------------------------------------------
 // Directory::WriteBack
 // 	Write any modifications to the directory back to disk
 //
 //	"file" -- file to contain the new directory contents
+//
+//	Return FALSE if a write came short: the file could not grow.  The
+//	header of a hashed directory is written last, so that it never
+//	counts a sector that is not there; Add made room for the sectors
+//	it added (see Grow), so only a new directory can fail.
 //----------------------------------------------------------------------
 
+#ifndef CHANGED
 void
 Directory::WriteBack(OpenFile *file)
 {
     (void) file->WriteAt((char *)table, tableSize * sizeof(DirectoryEntry), 0);
 }
+#else
+bool
+Directory::WriteBack(OpenFile *dirFile)
+{
+    int size = tableSize * sizeof(DirectoryEntry);
+
+    if (!hashed)
+	return dirFile->WriteAt((char *)table, size, 0) == size;
+    // The file of a new directory is empty: the header first, then
+    if (headerDirty && dirFile->Length() == 0) {
+	if (dirFile->WriteAt((char *) &header, SectorSize, 0) != SectorSize)
+	    return FALSE;
+	headerDirty = FALSE;
+    }
+    // the others in increasing order: the sectors added extend the file
+    for (int s = 1; s < numLoaded; s++)
+	if (dirty[s]) {
+	    if (dirFile->WriteAt(sectors[s], SectorSize, s * SectorSize)
+		!= SectorSize)
+		return FALSE;
+	    dirty[s] = FALSE;
+	}
+    if (headerDirty) {
+	if (dirFile->WriteAt((char *) &header, SectorSize, 0) != SectorSize)
+	    return FALSE;
+	headerDirty = FALSE;
+    }
+    return TRUE;
+}
+#endif
 
 //----------------------------------------------------------------------
 // Directory::FindIndex
@@ -97,6 +187,10 @@ Directory::WriteBack(OpenFile *file)
 int
 Directory::FindIndex(const char *name)
 {
+#ifdef CHANGED
+    if (hashed)
+	return Scan(name, NULL);
+#endif
     for (int i = 0; i < tableSize; i++)
         if (table[i].inUse && !strncmp(table[i].name, name, FileNameMaxLen))
 	    return i;
@@ -118,8 +212,13 @@ Directory::Find(const char *name)
 {
     int i = FindIndex(name);
 
+#ifdef CHANGED
+    if (i != -1)
+	return Slot(i)->sector;
+#else
     if (i != -1)
 	return table[i].sector;
+#endif
     return -1;
 }
 
@@ -132,12 +231,52 @@ Directory::Find(const char *name)
 //
 //	"name" -- the name of the file being added
 //	"newSector" -- the disk sector containing the added file's header
+//
+//	A hashed directory is full only when its file cannot grow: when
+//	the buckets of the chain of "name" are, a bucket is added to the
+//	chain.  The name is looked for, and a free entry, in the same pass
+//	over the chain.  Adding an entry may split a bucket, moving the
+//	new entry: "*Index" is where it is in the end.  The file grows
+//	before any bucket is changed; if it cannot, the directory is left
+//	as it was, or the bucket is not split.
 //----------------------------------------------------------------------
 
 
 bool
 Directory::Add(const char *name, int newSector, int *Index)
 { 
+#ifdef CHANGED
+    if (hashed) {
+	int i;
+
+	if (Scan(name, &i) != -1)
+	    return FALSE;
+	if (i < 0) {			// chain full: put a bucket in front
+	    int b = Address(Hash(name));
+
+	    if (header.numSectors + 2 > (int) MaxSector
+		|| !Grow(1 + NewTable(b)))
+		return FALSE;		// the file cannot grow that much
+	    i = AddBucket(b) * EntriesPerBucket;
+	}
+	DirectoryEntry *entry = Slot(i);
+	entry->inUse = TRUE;
+	entry->isFile = TRUE;
+	strncpy(entry->name, name, FileNameMaxLen);
+	entry->name[FileNameMaxLen] = '\0';
+	entry->sector = newSector;
+	Touch(i);
+	header.numEntries++;
+	headerDirty = TRUE;
+	if (header.numEntries > header.numBuckets * (int) EntriesPerBucket
+	    && header.numBuckets < (int) MaxBuckets
+	    && header.numSectors + 2 <= (int) MaxSector
+	    && Grow(1 + NewTable(header.numBuckets)))
+	    Split(&i);
+	*Index = i;
+	return TRUE;
+    }
+#endif
     if (FindIndex(name) != -1)
 	return FALSE;
 
@@ -157,7 +296,12 @@ void
 Directory::IsDirectory(int x)
 {
 
+#ifdef CHANGED
+    Slot(x)->isFile = FALSE;
+    Touch(x);
+#else
     table[x].isFile=FALSE;
+#endif
 }
 
 //----------------------------------------------------------------------
@@ -175,7 +319,16 @@ Directory::Remove(const char *name)
 
     if (i == -1)
 	return FALSE; 		// name not in directory
+#ifdef CHANGED
+    Slot(i)->inUse = FALSE;
+    Touch(i);
+    if (hashed) {
+	header.numEntries--;
+	headerDirty = TRUE;
+    }
+#else
     table[i].inUse = FALSE;
+#endif
     return TRUE;	
 }
 
@@ -187,22 +340,22 @@ Directory::Remove(const char *name)
 void
 Directory::List()
 {
+#ifndef CHANGED
    for (int i = 0; i < tableSize; i++)
 	if (table[i].inUse)
-     #ifndef CHANGED
         printf(" ");
 #else
+   for (int i = 0; i < NumSlots(); i++) {
+        DirectoryEntry *entry = Slot(i);
+
+	if (entry != NULL && entry->inUse)
         {
             FileHeader *fileheader = new FileHeader;
-            fileheader->FetchFrom(table[i].sector);
-            printf(" %-20s %8d bytes\n", table[i].name,fileheader->FileLength());
-            //if(table[i].isFile == TRUE)
-              //  printf("   File \n");
-            //else 
-              //  printf("   Directory \n");
-            //printf("%s\n", table[i].name);
+            fileheader->FetchFrom(entry->sector);
+            printf(" %-20s %8d bytes\n", entry->name,fileheader->FileLength());
             delete fileheader;
         }
+   }
 #endif
 }
 
@@ -218,17 +371,24 @@ Directory::Print()
     FileHeader *hdr = new FileHeader;
 
     printf("Directory contents:\n");
+#ifndef CHANGED
     for (int i = 0; i < tableSize; i++)
 	if (table[i].inUse) {
-#ifndef CHANGED
 	    printf("Name: %s, Sector: %d\n", table[i].name, table[i].sector);
 	    hdr->FetchFrom(table[i].sector);
+	    hdr->Print();
+	}
 #else
-            hdr->FetchFrom(table[i].sector);
-            printf("Name: %s, Sector: %d, Size: %d\n", table[i].name, table[i].sector,hdr->FileLength());
-#endif
+    for (int i = 0; i < NumSlots(); i++) {
+	DirectoryEntry *entry = Slot(i);
+
+	if (entry != NULL && entry->inUse) {
+            hdr->FetchFrom(entry->sector);
+            printf("Name: %s, Sector: %d, Size: %d\n", entry->name, entry->sector,hdr->FileLength());
 	    hdr->Print();
 	}
+    }
+#endif
     printf("\n");
     delete hdr;
 }
@@ -240,6 +400,18 @@ bool
 Directory::IsEmpty()
 {
     bool test = true;
+#ifdef CHANGED
+    // "." and ".." do not count; they are not always first when hashed
+    for (int i = 0; i < NumSlots(); i++) {
+        DirectoryEntry *entry = Slot(i);
+
+        if (entry != NULL && entry->inUse && strcmp(entry->name, ".") != 0
+            && strcmp(entry->name, "..") != 0) {
+            test = false;
+            break;
+        }
+    }
+#else
     for (int i = 2; i < tableSize; i++)
     if (table[i].inUse)
     {
@@ -248,6 +420,7 @@ Directory::IsEmpty()
         break;
 
     }
+#endif
     return test;
 }
 
@@ -266,3 +439,354 @@ Directory* Directory::ReadAtSector(int sector)
     delete curDir;
     return sub;
 }
+
+#ifdef CHANGED
+//----------------------------------------------------------------------
+// Directory::NumSlots, Directory::Slot
+// 	Entries are numbered from 0 in the table of the original format.
+//	In a hashed directory, entry k of sector s is entry
+//	s * EntriesPerBucket + k; the header and the table sectors have
+//	none.  Going through all of them reads the whole directory.
+//----------------------------------------------------------------------
+
+int
+Directory::NumSlots()
+{
+    if (!hashed)
+	return tableSize;
+    return header.numSectors * EntriesPerBucket;
+}
+
+DirectoryEntry *
+Directory::Slot(int i)
+{
+    int s = i / EntriesPerBucket;
+
+    if (!hashed)
+	return &table[i];
+    if (s == 0)
+	return NULL;
+    for (int t = 0; t < (int) NumTables; t++)
+	if (header.tables[t] == s)
+	    return NULL;
+    return &Bucket(s)->entries[i % EntriesPerBucket];
+}
+
+//----------------------------------------------------------------------
+// Directory::Touch
+// 	Entry "i" was changed: WriteBack must write its sector.
+//----------------------------------------------------------------------
+
+void
+Directory::Touch(int i)
+{
+    if (hashed) {
+	Bucket(i / EntriesPerBucket);		// loaded, then
+	dirty[i / EntriesPerBucket] = TRUE;
+    }
+}
+
+//----------------------------------------------------------------------
+// Directory::Load
+// 	Return sector "s" of a hashed directory, reading it from the
+//	directory file the first time, unless it is "fresh": then it is
+//	new, and zero.
+//----------------------------------------------------------------------
+
+char *
+Directory::Load(int s, bool fresh)
+{
+    ASSERT(hashed && s > 0 && s < header.numSectors);
+    if (s >= numLoaded) {			// grow the arrays
+	int size = 2 * s + 2;
+	char **newSectors = new char *[size];
+	bool *newDirty = new bool[size];
+
+	for (int t = 0; t < size; t++) {
+	    newSectors[t] = t < numLoaded ? sectors[t] : NULL;
+	    newDirty[t] = t < numLoaded ? dirty[t] : FALSE;
+	}
+	delete [] sectors;
+	delete [] dirty;
+	sectors = newSectors;
+	dirty = newDirty;
+	numLoaded = size;
+    }
+    if (sectors[s] == NULL) {
+	sectors[s] = new char[SectorSize];
+	if (!fresh) {
+	    ASSERT(file != NULL);	// or it would be in memory already
+	    (void) file->ReadAt(sectors[s], SectorSize, s * SectorSize);
+	}
+    }
+    if (fresh) {
+	bzero(sectors[s], SectorSize);
+	dirty[s] = TRUE;
+    }
+    return sectors[s];
+}
+
+DirectoryBucket *
+Directory::Bucket(int s)
+{
+    return (DirectoryBucket *) Load(s, FALSE);
+}
+
+//----------------------------------------------------------------------
+// Directory::NewSector
+// 	Add a zero sector at the end of a hashed directory, and return
+//	it.  Grow made room for it in the file.
+//----------------------------------------------------------------------
+
+int
+Directory::NewSector()
+{
+    int s = header.numSectors++;
+
+    headerDirty = TRUE;
+    Load(s, TRUE);
+    return s;
+}
+
+//----------------------------------------------------------------------
+// Directory::Grow
+// 	Make sure the directory file holds "n" sectors more than those in
+//	use, writing zeros at its end if need be, so that WriteBack cannot
+//	run out of space once the buckets are changed.  Return FALSE if
+//	the disk is full.  A directory not read from a file yet has none
+//	to grow: WriteBack makes it.
+//----------------------------------------------------------------------
+
+bool
+Directory::Grow(int n)
+{
+    int length = (header.numSectors + n) * SectorSize;
+    int more;
+    char *zeros;
+    bool grown;
+
+    if (file == NULL || file->Length() >= length)
+	return TRUE;
+    more = length - file->Length();
+    zeros = new char[more];
+    bzero(zeros, more);
+    grown = file->WriteAt(zeros, more, file->Length()) == more;
+    delete [] zeros;
+    return grown;
+}
+
+//----------------------------------------------------------------------
+// Directory::NewTable
+// 	Return the number of table sectors SetHead(b) adds: 1 if bucket
+//	"b" is past the direct ones and its table is not there yet.
+//----------------------------------------------------------------------
+
+int
+Directory::NewTable(int b)
+{
+    if (b < DirectBuckets
+	|| header.tables[(b - DirectBuckets) / BucketsPerTable] != 0)
+	return 0;
+    return 1;
+}
+
+//----------------------------------------------------------------------
+// Directory::Head, Directory::SetHead
+// 	Get or set the first sector of the chain of bucket "b": in the
+//	header for the first DirectBuckets, in a table sector for the
+//	others.  Tables are added as the buckets need them.
+//----------------------------------------------------------------------
+
+int
+Directory::Head(int b)
+{
+    int t = (b - DirectBuckets) / BucketsPerTable;
+
+    if (b < DirectBuckets)
+	return header.direct[b];
+    if (header.tables[t] == 0)
+	return 0;
+    return ((int *) Load(header.tables[t], FALSE))
+	[(b - DirectBuckets) % BucketsPerTable];
+}
+
+void
+Directory::SetHead(int b, int s)
+{
+    int t = (b - DirectBuckets) / BucketsPerTable;
+
+    if (b < DirectBuckets) {
+	header.direct[b] = s;
+	headerDirty = TRUE;
+	return;
+    }
+    if (header.tables[t] == 0) {
+	header.tables[t] = NewSector();
+	headerDirty = TRUE;
+    }
+    ((int *) Load(header.tables[t], FALSE))
+	[(b - DirectBuckets) % BucketsPerTable] = s;
+    dirty[header.tables[t]] = TRUE;
+}
+
+//----------------------------------------------------------------------
+// Directory::AddBucket
+// 	Put an empty bucket in front of the chain of bucket "b", and
+//	return its sector.
+//----------------------------------------------------------------------
+
+int
+Directory::AddBucket(int b)
+{
+    int s = NewSector();
+    DirectoryBucket *bucket = Bucket(s);
+
+    for (int k = 0; k < (int) EntriesPerBucket; k++) {
+	bucket->entries[k].inUse = FALSE;
+	bucket->entries[k].isFile = TRUE;
+    }
+    bucket->next = Head(b);
+    SetHead(b, s);
+    return s;
+}
+
+//----------------------------------------------------------------------
+// Directory::Address
+// 	Return the bucket of hash value "h".  With 2^L <= numBuckets
+//	< 2^(L+1), buckets below numBuckets - 2^L were split already,
+//	and take one bit more of "h" than the others.
+//----------------------------------------------------------------------
+
+int
+Directory::Address(unsigned int h)
+{
+    unsigned int level = 1;
+    unsigned int b;
+
+    while (2 * level <= (unsigned int) header.numBuckets)
+	level *= 2;
+    b = h % (2 * level);
+    if (b >= (unsigned int) header.numBuckets)
+	b = h % level;
+    return b;
+}
+
+//----------------------------------------------------------------------
+// Directory::Scan
+// 	Look for "name" in the chain it hashes to, and return its entry,
+//	or -1.  If "freeSlot" is not NULL, set it to the first free entry
+//	of the chain, or -1 if there is none.
+//----------------------------------------------------------------------
+
+int
+Directory::Scan(const char *name, int *freeSlot)
+{
+    if (freeSlot != NULL)
+	*freeSlot = -1;
+    for (int s = Head(Address(Hash(name))); s != 0; s = Bucket(s)->next)
+	for (int k = 0; k < (int) EntriesPerBucket; k++) {
+	    DirectoryEntry *entry = &Bucket(s)->entries[k];
+
+	    if (!entry->inUse) {
+		if (freeSlot != NULL && *freeSlot < 0)
+		    *freeSlot = s * EntriesPerBucket + k;
+	    } else if (!strncmp(entry->name, name, FileNameMaxLen))
+		return s * EntriesPerBucket + k;
+	}
+    return -1;
+}
+
+//----------------------------------------------------------------------
+// Directory::Split
+// 	Add a bucket to the hash table, and give it the entries of the
+//	bucket it splits that now hash to it.  The entries of the chain
+//	are packed again, those staying at the front of its sectors, and
+//	the new chain takes the sectors at the end, so that holes do not
+//	pile up; a sector is added only when they do not fit.  If entry
+//	"*track" is moved, set "*track" to where it goes.
+//----------------------------------------------------------------------
+
+void
+Directory::Split(int *track)
+{
+    int from = Address(header.numBuckets);	// the bucket split: the
+    int to = header.numBuckets++;		// one "to" hashed to
+    int numChain = 0, numEntries = 0, stay, fromSectors;
+    int s, j, k;
+
+    headerDirty = TRUE;
+    DEBUG('f', "Splitting directory bucket %d into %d\n", from, to);
+    for (s = Head(from); s != 0; s = Bucket(s)->next)
+	numChain++;
+    int *chain = new int[numChain + 1];
+    DirectoryEntry *entries = new DirectoryEntry[numChain * EntriesPerBucket];
+    int *oldSlot = new int[numChain * EntriesPerBucket];
+
+    // The entries staying first, then those moving
+    numChain = 0;
+    for (s = Head(from); s != 0; s = Bucket(s)->next)
+	chain[numChain++] = s;
+    for (int pass = 0; pass < 2; pass++) {
+	if (pass == 1)
+	    stay = numEntries;
+	for (j = 0; j < numChain; j++)
+	    for (k = 0; k < (int) EntriesPerBucket; k++) {
+		DirectoryEntry *entry = &Bucket(chain[j])->entries[k];
+
+		if (entry->inUse
+		    && (Address(Hash(entry->name)) == to) == (pass == 1)) {
+		    oldSlot[numEntries] = chain[j] * EntriesPerBucket + k;
+		    entries[numEntries++] = *entry;
+		}
+	    }
+    }
+    int toSectors = divRoundUp(numEntries - stay, (int) EntriesPerBucket);
+
+    if (divRoundUp(stay, (int) EntriesPerBucket) + toSectors > numChain)
+	chain[numChain++] = NewSector();
+    fromSectors = numChain - toSectors;	// holes included
+
+    for (j = 0; j < numChain; j++) {
+	DirectoryBucket *bucket = Bucket(chain[j]);
+
+	for (k = 0; k < (int) EntriesPerBucket; k++) {
+	    bucket->entries[k].inUse = FALSE;
+	    bucket->entries[k].isFile = TRUE;
+	}
+	bucket->next = (j + 1 == fromSectors || j + 1 == numChain)
+	    ? 0 : chain[j + 1];
+	dirty[chain[j]] = TRUE;
+    }
+    for (int e = 0; e < numEntries; e++) {
+	int i = e < stay ? e : fromSectors * EntriesPerBucket + e - stay;
+	int slot = chain[i / EntriesPerBucket] * EntriesPerBucket
+	    + i % EntriesPerBucket;
+
+	*Slot(slot) = entries[e];
+	if (*track == oldSlot[e])
+	    *track = slot;
+    }
+    SetHead(from, fromSectors > 0 ? chain[0] : 0);
+    SetHead(to, toSectors > 0 ? chain[fromSectors] : 0);
+
+    delete [] chain;
+    delete [] entries;
+    delete [] oldSlot;
+}
+
+//----------------------------------------------------------------------
+// Directory::Hash
+// 	Return the hash value of "name".  Only the characters compared
+//	by FindIndex count.
+//----------------------------------------------------------------------
+
+unsigned int
+Directory::Hash(const char *name)
+{
+    unsigned int h = 0;
+
+    for (int i = 0; i < FileNameMaxLen && name[i] != '\0'; i++)
+	h = h * 31 + (unsigned char) name[i];
+    return h;
+}
+#endif
@@ -18,6 +18,9 @@
 #define DIRECTORY_H
 
 #include "openfile.h"
+#ifdef CHANGED
+#include "disk.h"
+#endif
 
 #define FileNameMaxLen 		20	// for simplicity, we assume 
 					// file names are <= 9 characters long
@@ -39,6 +42,54 @@ class DirectoryEntry {
 					// the trailing '\0'
 };
 
+#ifdef CHANGED
+// Hashed directories.  The first sector of the directory file is a
+// DirectoryHeader; the others are buckets of a few entries each, and
+// tables of buckets.  The hash of a name selects a bucket, the first
+// sector of a chain; only those sectors are read to find the name.
+//
+// The table grows by linear hashing: when the entries would no longer
+// fit one bucket per chain, the next bucket in turn is split in two,
+// and about half of its entries move to the new one, added at the end.
+// Lookups thus read about one bucket, and a table sector past the
+// first DirectBuckets buckets, however many files there are.  A chain
+// gets more buckets when it is full, so the directory is only full
+// when its file is as large as a file can be; past MaxBuckets buckets,
+// the chains get longer instead.
+//
+// A directory file that does not start with DirectoryMagic is a table
+// of entries, as in the original format.
+
+#define DirectoryMagic		0x44495249
+#define DirectBuckets		12
+#define BucketsPerTable		(SectorSize / sizeof(int))
+#define NumTables		((SectorSize - (4 + DirectBuckets) * sizeof(int)) \
+				 / sizeof(int))
+#define MaxBuckets		(DirectBuckets + NumTables * BucketsPerTable)
+#define EntriesPerBucket	((SectorSize - sizeof(int)) \
+				 / sizeof(DirectoryEntry))
+
+class DirectoryHeader {
+  public:
+    int magic;
+    int numSectors;			// sectors of the file in use, this
+					// one included
+    int numBuckets;			// buckets of the hash table
+    int numEntries;			// entries in use
+    int direct[DirectBuckets];		// first sector of the chain of
+					// each of the first buckets, or 0
+    int tables[NumTables];		// sectors holding those of the
+					// next buckets, BucketsPerTable
+					// each, or 0
+};
+
+class DirectoryBucket {
+  public:
+    int next;				// next sector of the chain, or 0
+    DirectoryEntry entries[EntriesPerBucket];
+};
+#endif
+
 // The following class defines a UNIX-like "directory".  Each entry in
 // the directory describes a file, and where to find it on disk.
 //
@@ -56,8 +107,14 @@ class Directory {
     ~Directory();			// De-allocate the directory
 
     void FetchFrom(OpenFile *file);  	// Init directory contents from disk
+#ifdef CHANGED
+    bool WriteBack(OpenFile *file);	// Write modifications to 
+					// directory contents back to disk;
+					// FALSE if the file could not grow
+#else
     void WriteBack(OpenFile *file);	// Write modifications to 
 					// directory contents back to disk
+#endif
 
     int Find(const char *name);		// Find the sector number of the 
 					// FileHeader for file: "name"
@@ -82,6 +139,35 @@ class Directory {
 
     int FindIndex(const char *name);	// Find the index into the directory 
 					//  table corresponding to "name"
+#ifdef CHANGED
+    bool hashed;			// hashed format, or a table?
+    OpenFile *file;			// the directory file, while the
+					// buckets are read from it
+    DirectoryHeader header;
+    bool headerDirty;			// header changed since fetched?
+    char **sectors;			// the sectors of the file read or
+    bool *dirty;			// changed so far, and which of them
+    int numLoaded;			// to write back; size of both arrays
+
+    int NumSlots();			// entries of the directory, counting
+    DirectoryEntry *Slot(int i);	// the other sectors; entry "i", or
+					// NULL for one of those
+    void Touch(int i);			// entry "i" is changed
+    char *Load(int s, bool fresh);	// sector "s", read if need be
+    DirectoryBucket *Bucket(int s);	// the same, as a bucket
+    int NewSector();			// add a sector at the end of the file
+    bool Grow(int n);			// make room in the file for "n" more
+    int NewTable(int b);		// table sectors SetHead(b) would add
+    int Head(int b);			// first sector of the chain of
+    void SetHead(int b, int s);		// bucket "b", or 0
+    int AddBucket(int b);		// put a new sector in front of it
+    int Address(unsigned int h);	// bucket of hash value "h"
+    int Scan(const char *name, int *freeSlot);
+					// FindIndex, and the first free
+					// entry of the chain of "name"
+    void Split(int *track);		// split the next bucket
+    static unsigned int Hash(const char *name);
+#endif
 };
 
 #endif // DIRECTORY_H
@@ -32,12 +32,51 @@
 #ifdef CHANGED
 FileHeader::FileHeader()
 {
+     layout = EXTENTS;
      numBytes = 0;
      numSectors = 0;
+     allocGoal = 0;
+     for (int i = 0; i < (int)NumDirect; i++) {
+        dataSectors[i] = 0;         // no extent in use
+        indexCache[i] = NULL;
+     }
 }
 
 FileHeader::~FileHeader()
 {
+    DropIndexCache();
+}
+
+//----------------------------------------------------------------------
+// FileHeader::IndexBlock
+// 	Return the sector numbers stored in index sector "index", from
+//	memory once they have been read.  If "fresh", the index sector has
+//	just been allocated: start from an empty block instead of reading
+//	it.  Whoever changes the block writes it back to the sector.
+//----------------------------------------------------------------------
+
+int *
+FileHeader::IndexBlock(int index, bool fresh)
+{
+    if (indexCache[index] != NULL && !fresh)
+        return indexCache[index];
+    if (indexCache[index] == NULL)
+        indexCache[index] = new int[MaxPerSector];
+    if (fresh) {
+        for (int j = 0; j < (int)MaxPerSector; j++)
+            indexCache[index][j] = 0;
+    } else
+        bufferCache->ReadSector(dataSectors[index], (char *)indexCache[index]);
+    return indexCache[index];
+}
+
+void
+FileHeader::DropIndexCache()
+{
+    for (int i = 0; i < (int)NumDirect; i++) {
+        delete [] indexCache[i];
+        indexCache[i] = NULL;
+    }
 }
 #endif
 //----------------------------------------------------------------------
@@ -56,6 +95,9 @@ bool
 FileHeader::Allocate(BitMap *freeMap, int Size)
 { 
 #ifdef CHANGED
+    if (layout == EXTENTS)
+        return AllocateExtents(freeMap, Size);
+
     //if (Size == 0) return TRUE;
     int i, j, k;
 
@@ -74,13 +116,10 @@ FileHeader::Allocate(BitMap *freeMap, int Size)
 
 //allocate the initial first sector when file is newly created
     if (numSectors == 0)
-        ASSERT (dataSectors[0] = freeMap->Find());
+        ASSERT (dataSectors[0] = FindSector(freeMap));
     
-//create a buffer space to store sector# info
-    int *dataset = new int[MaxPerSector];
-
-//read the current index# info into buffer
-    synchDisk->ReadSector(dataSectors[index],(char*)dataset);
+//the current index# info, kept in memory
+    int *dataset = IndexBlock(index, numSectors == 0);
 
 //k is the number of byte;j is the number of numSectors;i is the number of needed sectors
     for (k = 0,i = 0,j = numSectors % MaxPerSector;i < newSectors;i++)
@@ -91,17 +130,18 @@ FileHeader::Allocate(BitMap *freeMap, int Size)
               {
 
                    //allocate new sector space
-                    dataset[j] = freeMap->Find();
+                    dataset[j] = FindSector(freeMap);
                     j = (j + 1) % MaxPerSector;
 
                    //if number of numSectors reach one index size,we need to jump into next index
                     if (j == 0)
                     {
-                          synchDisk->WriteSector(dataSectors[index],(char*)dataset);
+                          bufferCache->WriteSector(dataSectors[index],(char*)dataset);
                           if (index < (int)(NumDirect - 1))
                           {
                              index++;
-                             dataSectors[index] = freeMap->Find();
+                             dataSectors[index] = FindSector(freeMap);
+                             dataset = IndexBlock(index, TRUE);
                           }
                     }
               }
@@ -119,7 +159,7 @@ FileHeader::Allocate(BitMap *freeMap, int Size)
               k++;
         }
     }
-    synchDisk->WriteSector(dataSectors[index],(char*)dataset);
+    bufferCache->WriteSector(dataSectors[index],(char*)dataset);
     numSectors = j + index * MaxPerSector;
 #else
     numBytes = Size;
@@ -133,6 +173,191 @@ FileHeader::Allocate(BitMap *freeMap, int Size)
     return TRUE;
 }
 
+#ifdef CHANGED
+//----------------------------------------------------------------------
+// FindRun
+// 	Find free sectors for "wanted" more sectors of a file whose last
+//	sector is just before "goal".  The best is a run starting at
+//	"goal" itself, which extends the last extent; then the first free
+//	run of "wanted" sectors from "goal" on; then the longest free run.
+//	"run" may be shorter than "wanted": the caller asks again.
+//----------------------------------------------------------------------
+
+static void
+FindRun(BitMap *freeMap, int goal, int wanted, Extent *run)
+{
+    int s, n, length;
+    int best = -1, bestLength = 0;
+
+    if (goal >= NumSectors)
+        goal = 0;
+    if (!freeMap->Test(goal)) {
+        for (length = 0; goal + length < NumSectors && length < wanted
+                 && !freeMap->Test(goal + length); length++)
+            ;
+        run->start = goal;
+        run->length = length;
+        return;
+    }
+    for (s = goal, n = 0; n < NumSectors; ) {
+        if (freeMap->Test(s)) {
+            s = (s + 1) % NumSectors;
+            n++;
+            continue;
+        }
+        for (length = 0; s + length < NumSectors && length < wanted
+                 && !freeMap->Test(s + length); length++)
+            ;
+        if (length == wanted) {
+            best = s;
+            bestLength = length;
+            break;
+        }
+        if (length > bestLength) {
+            best = s;
+            bestLength = length;
+        }
+        n += length;
+        s = (s + length) % NumSectors;
+    }
+    ASSERT(bestLength > 0);
+    run->start = best;
+    run->length = bestLength;
+}
+
+//----------------------------------------------------------------------
+// FileHeader::AllocateExtents
+// 	Allocate for an extent file, contiguously if possible, so that
+//	sequential accesses do not seek.  If the file would need more
+//	than NumExtents runs, convert it to the indexed layout instead.
+//----------------------------------------------------------------------
+
+bool
+FileHeader::AllocateExtents(BitMap *freeMap, int fileSize)
+{
+    int wanted = divRoundUp(numBytes + fileSize, SectorSize) - numSectors;
+    int used = NumUsedExtents();
+    int needed = used, numRuns = 0;
+    Extent runs[NumExtents + 1];
+    int goal, left, i, s;
+
+    if ((numBytes + fileSize > (int)MaxFileSize) ||
+        (freeMap->NumClear() < wanted))
+        return FALSE;   // not enough space
+
+    goal = (used > 0) ? extents[used - 1].start + extents[used - 1].length
+                      : allocGoal;
+    for (left = wanted; left > 0 && needed <= (int)NumExtents; numRuns++) {
+        FindRun(freeMap, goal, left, &runs[numRuns]);
+        for (s = runs[numRuns].start;
+             s < runs[numRuns].start + runs[numRuns].length; s++)
+            freeMap->Mark(s);
+        if (used == 0 || numRuns > 0 || runs[numRuns].start != goal)
+            needed++;           // does not extend the last extent
+        left -= runs[numRuns].length;
+        goal = runs[numRuns].start + runs[numRuns].length;
+    }
+
+    if (needed > (int)NumExtents) {
+        // Too fragmented: give the runs back, and use index sectors,
+        // if there is room for them too; otherwise leave the file as is
+        for (i = 0; i < numRuns; i++)
+            for (s = runs[i].start; s < runs[i].start + runs[i].length; s++)
+                freeMap->Unmark(s);
+        int newSectors = divRoundUp(fileSize, SectorSize);
+        int newIndex = (numSectors + newSectors) / MaxPerSector
+            - numSectors / MaxPerSector;
+        // the index sectors so far (for an empty file, Allocate makes
+        // the first one), the new ones, and the data
+        if (freeMap->NumClear() < numSectors / (int)MaxPerSector + 1
+                                  + newIndex + newSectors)
+            return FALSE;       // not enough space
+        ConvertToIndexed(freeMap);
+        return Allocate(freeMap, fileSize);
+    }
+
+    for (i = 0; i < numRuns; i++) {
+        if (used > 0 &&
+            runs[i].start == extents[used - 1].start + extents[used - 1].length)
+            extents[used - 1].length += runs[i].length;
+        else
+            extents[used++] = runs[i];
+    }
+    numSectors += wanted;
+    numBytes += fileSize;
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// FileHeader::ConvertToIndexed
+// 	Switch an extent file to the indexed layout: write the numbers of
+//	its data sectors to newly allocated index sectors.  As the indexed
+//	Allocate expects, there is an index sector for the next data
+//	sector too, unless the file is empty: Allocate makes the first
+//	one then.  The caller has checked that there are enough free
+//	sectors.
+//----------------------------------------------------------------------
+
+void
+FileHeader::ConvertToIndexed(BitMap *freeMap)
+{
+    int *sectors = new int[numSectors];
+    int *dataset;
+    int numIndex = numSectors == 0 ? 0 : numSectors / MaxPerSector + 1;
+    int i, j, n = 0;
+
+    DEBUG('f', "Converting a file of %d sectors to index sectors\n", numSectors);
+    for (i = 0; i < (int)NumExtents && extents[i].length > 0; i++)
+        for (j = 0; j < extents[i].length; j++)
+            sectors[n++] = extents[i].start + j;
+    ASSERT(n == numSectors);
+
+    layout = INDEXED;           // dataSectors[] overwrite extents[]
+    for (i = 0; i < numIndex; i++) {
+        dataSectors[i] = FindSector(freeMap);
+        ASSERT(dataSectors[i] != -1);
+        dataset = IndexBlock(i, TRUE);
+        for (j = 0; j < (int)MaxPerSector; j++)
+            dataset[j] = (i * (int)MaxPerSector + j < numSectors) ?
+                sectors[i * MaxPerSector + j] : 0;
+        bufferCache->WriteSector(dataSectors[i], (char *)dataset);
+    }
+    delete [] sectors;
+}
+
+//----------------------------------------------------------------------
+// FileHeader::FindSector
+// 	Allocate the first free sector from allocGoal on, and move the
+//	goal past it, so that the sectors allocated one at a time by an
+//	indexed file follow each other.
+//----------------------------------------------------------------------
+
+int
+FileHeader::FindSector(BitMap *freeMap)
+{
+    int sector = freeMap->FindFrom(allocGoal);
+
+    if (sector >= 0)
+        allocGoal = sector + 1;
+    return sector;
+}
+
+//----------------------------------------------------------------------
+// FileHeader::NumUsedExtents
+// 	Return how many entries of extents[] are in use.
+//----------------------------------------------------------------------
+
+int
+FileHeader::NumUsedExtents()
+{
+    int i;
+
+    for (i = 0; i < (int)NumExtents && extents[i].length > 0; i++)
+        ;
+    return i;
+}
+#endif
+
 //----------------------------------------------------------------------
 // FileHeader::Deallocate
 //  De-allocate all the space allocated for data blocks for this file.
@@ -145,7 +370,28 @@ FileHeader::Allocate(BitMap *freeMap, int Size)
 void 
 FileHeader::Deallocate(BitMap *freeMap, int reservebytes)
 {
-    int *dataset = new int[MaxPerSector];
+    if (layout == EXTENTS) {
+        int keep = divRoundUp(reservebytes, SectorSize);
+
+        for (int i = 0; i < (int)NumExtents; i++) {
+            if (keep >= extents[i].length) {
+                keep -= extents[i].length;
+                continue;
+            }
+            for (int s = extents[i].start + keep;
+                 s < extents[i].start + extents[i].length; s++) {
+                ASSERT(freeMap->Test(s));   // ought to be marked!
+                freeMap->Clear(s);
+            }
+            extents[i].length = keep;
+            keep = 0;
+        }
+        numSectors = divRoundUp(reservebytes, SectorSize);
+        numBytes = reservebytes;
+        return;
+    }
+
+    int *dataset;
 
 //freesector is where we start to release sector#(start from zero)
     int freesector = reservebytes / SectorSize;
@@ -155,7 +401,7 @@ FileHeader::Deallocate(BitMap *freeMap, int reservebytes)
 //index is where we start to read index to relase all(start from zero)
     int index = freesector / MaxPerSector;
 
-    synchDisk->ReadSector(dataSectors[index],(char*)dataset);
+    dataset = IndexBlock(index, FALSE);
     for (int j = freesector % MaxPerSector,i = freesector;i < numSectors;i++,j = ( j + 1 ) % MaxPerSector) 
     {
         if(j == 0 && i > freesector && index < (int)(NumDirect - 1))
@@ -166,7 +412,7 @@ FileHeader::Deallocate(BitMap *freeMap, int reservebytes)
                    ASSERT(freeMap->Test((int) dataSectors[index]));
                    freeMap->Clear((int) dataSectors[index]);
                }
-               synchDisk->ReadSector(dataSectors[index],(char*)dataset);
+               dataset = IndexBlock(index, FALSE);
         }
   //      ASSERT(freeMap->Test((int) dataset[j]));  // ought to be marked!
 
@@ -197,7 +443,12 @@ FileHeader::Deallocate(BitMap *freeMap)
 void
 FileHeader::FetchFrom(int sector)
 {
+#ifdef CHANGED
+    DropIndexCache();                   // of the previous contents
+    bufferCache->ReadSector(sector, (char *)this);
+#else
     synchDisk->ReadSector(sector, (char *)this);
+#endif
 }
 
 //----------------------------------------------------------------------
@@ -210,7 +461,11 @@ FileHeader::FetchFrom(int sector)
 void
 FileHeader::WriteBack(int sector)
 {
+#ifdef CHANGED
+    bufferCache->WriteSector(sector, (char *)this); 
+#else
     synchDisk->WriteSector(sector, (char *)this); 
+#endif
 }
 
 //----------------------------------------------------------------------
@@ -229,17 +484,25 @@ FileHeader::ByteToSector(int offset)
 #ifdef CHANGED
     if(offset > FileLength())
         return -1;
+    if (layout == EXTENTS) {
+        int sector = offset / SectorSize;
+
+        for (int i = 0; i < (int)NumExtents && extents[i].length > 0; i++) {
+            if (sector < extents[i].length)
+                return extents[i].start + sector;
+            sector -= extents[i].length;
+        }
+        return -1;
+    }
     int sectors,indexs;
     //if (offset % SectorSize || offset == 0)
         sectors = offset / SectorSize;
     //else
      //   sectors = offset / SectorSize - 1;
     indexs = sectors / MaxPerSector;
-    int *dataset = new int[MaxPerSector];
-    synchDisk->ReadSector(dataSectors[indexs],(char*)dataset);
 
 //return sector# where offset byte data block settled in
-    return(dataset[sectors%MaxPerSector]);
+    return(IndexBlock(indexs, FALSE)[sectors%MaxPerSector]);
 #else
     return(dataSectors[offset / SectorSize]);
 #endif
@@ -268,29 +531,50 @@ FileHeader::Print()
 #ifdef CHANGED
     int i, j, k, t, index = 0;
     char *data = new char[SectorSize];
+
+    if (layout == EXTENTS) {
+        printf("FileHeader contents.  File size: %d.  File extents:\n", numBytes);
+        for (i = 0; i < (int)NumExtents && extents[i].length > 0; i++)
+            printf("%d-%d ", extents[i].start,
+                   extents[i].start + extents[i].length - 1);
+        printf("\nFile contents:\n");
+        for (i = k = 0; i < numSectors; i++) {
+            bufferCache->ReadSector(ByteToSector(i * SectorSize), data);
+            for (j = 0; (j < SectorSize) && (k < numBytes); j++, k++) {
+                if ('\040' <= data[j] && data[j] <= '\176')   // isprint(data[j])
+                    printf("%c", data[j]);
+                else
+                    printf("\\%x", (unsigned char)data[j]);
+            }
+            printf("\n");
+        }
+        delete [] data;
+        return;
+    }
+
     int *dataset = new int[MaxPerSector];
-    synchDisk->ReadSector(dataSectors[index],(char*)dataset);
+    bufferCache->ReadSector(dataSectors[index],(char*)dataset);
     printf("FileHeader contents.  File size: %d.  File blocks:\n", numBytes);
     for (i = 0,t = 0;i < numSectors;i++,t = (t + 1) % MaxPerSector)
     {
         if (i > 0 && t == 0)
         {
              index++;
-             synchDisk->ReadSector(dataSectors[index],(char*)dataset);
+             bufferCache->ReadSector(dataSectors[index],(char*)dataset);
         }
   printf("%d ", dataset[t]);
     }
     index = 0;
-    synchDisk->ReadSector(dataSectors[index],(char*)dataset);
+    bufferCache->ReadSector(dataSectors[index],(char*)dataset);
     printf("\nFile contents:\n");
     for (i = t = k = 0;i < numSectors;i++,t = (t + 1) % MaxPerSector) 
     {
         if (i > 0 && t == 0)
         {
              index++;
-             synchDisk->ReadSector(dataSectors[index],(char*)dataset);
+             bufferCache->ReadSector(dataSectors[index],(char*)dataset);
         }
-        synchDisk->ReadSector(dataset[t],data);
+        bufferCache->ReadSector(dataset[t],data);
         for (j = 0; (j < SectorSize) || (k < numBytes); j++, k++) 
         {
       if ('\040' <= data[j] && data[j] <= '\176')   // isprint(data[j])
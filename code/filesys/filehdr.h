@@ -18,9 +18,15 @@
 #include "../userprog/bitmap.h"
 
 // number of direct index for each fileheader(inode) increase from 3kb to 120kb
+#ifdef CHANGED
+// (after type, layout, numBytes and numSectors)
+#define NumDirect   ((SectorSize - 4 * sizeof(int)) / sizeof(int)) 
+#else
 #define NumDirect   ((SectorSize - 2 * sizeof(int)) / sizeof(int)) 
+#endif
 
 #ifdef CHANGED
+#define NumExtents      (NumDirect / 2)
 
 #define MaxPerSector    ((SectorSize) / sizeof(int))
 #define MaxSector       (NumDirect * MaxPerSector)
@@ -33,6 +39,14 @@
 
 #endif
 
+#ifdef CHANGED
+// A run of consecutive data sectors of a file
+class Extent {
+  public:
+    int start;			// first sector of the run
+    int length;			// number of sectors, 0 if the entry is free
+};
+#endif
 
 // The following class defines the Nachos "file header" (in UNIX terms,  
 // the "i-node"), describing where on disk to find all of the data in the file.
@@ -59,6 +73,14 @@ class FileHeader {
         DOTLINK
     };
 
+    // How the data sectors are found.  New files use extents; a file too
+    // fragmented for NumExtents runs is converted to index sectors
+    enum Layout {
+        INDEXED,		// dataSectors[] are index sectors, each
+				// holding MaxPerSector data sector numbers
+        EXTENTS			// extents[] are the runs of data sectors
+    };
+
     FileHeader();
 
     ~FileHeader();
@@ -93,14 +115,41 @@ class FileHeader {
     FileType Type_Get();
     void LinkSector_Set(int sector);
     int LinkSector_Get();
+    void SetAllocationGoal(int sector) { allocGoal = sector; }
+					// Allocate the next sectors from
+					// "sector" on, if they are free
     FileType type;
  #endif
     
   private:
+#ifdef CHANGED
+    Layout layout;
+#endif
     int numBytes;			// Number of bytes in the file
     int numSectors;			// Number of data sectors in the file
+#ifdef CHANGED
+    union {
     int dataSectors[NumDirect];		// Disk sector numbers for each data 
 					// block in the file
+    Extent extents[NumExtents];		// or the runs of data sectors
+    };
+
+    int *indexCache[NumDirect];		// contents of the index sectors
+					// read or written so far, or NULL
+					// (not part of the sector on disk)
+    int *IndexBlock(int index, bool fresh);
+    void DropIndexCache();
+    int allocGoal;			// where to look for free sectors
+					// first (not on disk either)
+    int FindSector(BitMap *freeMap);	// allocate one sector near allocGoal
+
+    int NumUsedExtents();
+    bool AllocateExtents(BitMap *freeMap, int fileSize);
+    void ConvertToIndexed(BitMap *freeMap);
+#else
+    int dataSectors[NumDirect];		// Disk sector numbers for each data 
+					// block in the file
+#endif
 };
 
 #endif // FILEHDR_H
@@ -79,6 +79,14 @@
 #define FreeMapFileSize 	(NumSectors / BitsInByte)
 #define NumDirEntries 		100
 #define DirectoryFileSize 	(sizeof(DirectoryEntry) * NumDirEntries)
+#ifdef CHANGED
+// Directories are hashed now (see directory.h), and grow: NumDirEntries
+// only bounds those in the original format.  The root directory keeps
+// DirectoryFileSize, so that formatting adds its first buckets without
+// growing it, before the free sector map is in place.
+
+bool FileSystem::groupPlacement = TRUE;
+#endif
 
 //----------------------------------------------------------------------
 // FileSystem::FileSystem
@@ -96,6 +104,11 @@
 FileSystem::FileSystem(bool format)
 { 
     DEBUG('f', "Initializing the file system.\n");
+#ifdef CHANGED
+    freeMapLock = new Lock("free map");
+    heldFrees = new BitMap(NumSectors);
+    committedFrees = new BitMap(NumSectors);
+#endif
     if (format) {
         BitMap *freeMap = new BitMap(NumSectors);
         Directory *directory = new Directory(NumDirEntries);
@@ -108,10 +121,23 @@ FileSystem::FileSystem(bool format)
     // (make sure no one else grabs these!)
 	freeMap->Mark(FreeMapSector);	    
 	freeMap->Mark(DirectorySector);
+#ifdef CHANGED
+	for (int i = LogStart; i < NumSectors; i++)
+	    freeMap->Mark(i);		// the log area, at the end
+	journal->Format();
+	// The disk was mounted before "-f" formats it: the headers read
+	// then are not those of the new files
+	inodeTable->Detach(FreeMapSector);
+	inodeTable->Detach(DirectorySector);
+#endif
 
     // Second, allocate space for the data blocks containing the contents
     // of the directory and bitmap files.  There better be enough space!
 
+#ifdef CHANGED
+	mapHdr->SetAllocationGoal(DataGoal(FreeMapSector));
+	dirHdr->SetAllocationGoal(DataGoal(DirectorySector));
+#endif
 	ASSERT(mapHdr->Allocate(freeMap, FreeMapFileSize));
 	ASSERT(dirHdr->Allocate(freeMap, DirectoryFileSize));
 
@@ -145,6 +171,8 @@ FileSystem::FileSystem(bool format)
 	directory->WriteBack(directoryFile);
 
 #ifdef CHANGED
+    residentFreeMap = freeMap;		// kept, and used by Create
+
         // Create a symbolic link to the current folder
     Create(".", FileHeader::DOTLINK);
     Create("..", FileHeader::DOTLINK);
@@ -187,7 +215,9 @@ FileSystem::FileSystem(bool format)
 	    freeMap->Print();
 	    directory->Print();
 
+#ifndef CHANGED
         delete freeMap; 
+#endif
 	delete directory; 
 	delete mapHdr; 
 	delete dirHdr;
@@ -195,11 +225,19 @@ FileSystem::FileSystem(bool format)
     } else {
     // if we are not formatting the disk, just open the files representing
     // the bitmap and directory; these are left open while Nachos is running
+#ifdef CHANGED
+        journal->Recover();		// before anything is read
+#endif
         freeMapFile = new OpenFile(FreeMapSector);
         directoryFile = new OpenFile(DirectorySector);
+#ifdef CHANGED
+        residentFreeMap = new BitMap(NumSectors);
+        residentFreeMap->FetchFrom(freeMapFile);
+#endif
     }
 
 #ifdef CHANGED
+    residentFreeMap->DeferClears(heldFrees);	// see CommitFrees
 
     const char *names[] = {"ls", "mkdir", "cd", "rm", "PutChar", "PutString", "fork-test", "userpages0-test", "userpages1-test",
                             "join_multithread-test", "multopen-test", "mulpopen-test", "fork1-test", "fork2-test", "conopen-test"};
@@ -262,12 +300,16 @@ bool FileSystem::Create(const char *name, FileHeader::FileType type) {
     bool success;
     int index [1];
 
+#ifdef CHANGED
+    journal->Begin(SmallOpReserve);
+#endif
     directory = new Directory(NumDirEntries);
     directory->FetchFrom(directoryFile);
 
     if (directory->Find(name) != -1)
       success = FALSE;			// file is already in directory
     else {	
+#ifndef CHANGED
         freeMap = new BitMap(NumSectors);
         freeMap->FetchFrom(freeMapFile);
         sector = freeMap->Find();	// find a sector to hold the file header
@@ -280,21 +322,12 @@ bool FileSystem::Create(const char *name, FileHeader::FileType type) {
       	else {
     	    hdr = new FileHeader;
 //    	    printf("Index is %d \n ",index[0]);
-#ifndef CHANGED
 
 	    if (!hdr->Allocate(freeMap, initialSize)) // for create file
-#else
-	    	directory->IsDirectory(index[0]); // needs checking
-            if (!hdr->Allocate(freeMap, 0)) // Directory
-
-#endif
             	success = FALSE;	// no space on disk for data
 	    else {	
 	    	success = TRUE;
 		// everthing worked, flush all changes back to disk
-        #ifdef CHANGED
-                hdr->Type_Set(type);   //type = type; // for Directory
-        #endif
 
     	    	hdr->WriteBack(sector); 		
     	    	directory->WriteBack(directoryFile);
@@ -303,8 +336,43 @@ bool FileSystem::Create(const char *name, FileHeader::FileType type) {
             delete hdr;
 	}
         delete freeMap;
+#else
+        freeMap = AcquireFreeMap();
+        sector = freeMap->FindFrom(HeaderGoal(freeMap, type));
+					// find a sector to hold the file header
+        hdr = new FileHeader;
+        hdr->SetAllocationGoal(DataGoal(sector));
+    	if (sector == -1) 		
+            success = FALSE;		// no free block for file header 
+        else if (!hdr->Allocate(freeMap, 0)) {
+            success = FALSE;		// no space on disk for data
+            freeMap->Clear(sector);
+        } else
+            success = TRUE;
+        ReleaseFreeMap();		// before the directory may grow
+
+        // Add grows the directory first, and changes nothing if it cannot
+        if (success && !directory->Add(name, sector, index)) {
+            success = FALSE;		// no space in directory
+            freeMap = AcquireFreeMap();
+            hdr->Deallocate(freeMap, 0);
+            freeMap->Clear(sector);
+            ReleaseFreeMap();
+        }
+        if (success) {
+	    // everthing worked, flush all changes back to disk
+	    directory->IsDirectory(index[0]); // needs checking
+            hdr->Type_Set(type);	// for Directory
+    	    hdr->WriteBack(sector);
+    	    success = directory->WriteBack(directoryFile);
+        }
+        delete hdr;
+#endif
     }
     delete directory;
+#ifdef CHANGED
+    journal->End();
+#endif
     return success;
 }
 
@@ -371,32 +439,54 @@ FileSystem::Remove(const char *name)
     FileHeader *fileHdr;
     int sector;
     
+#ifdef CHANGED
+    journal->Begin(SmallOpReserve);
+#endif
     directory = new Directory(NumDirEntries);
     directory->FetchFrom(directoryFile);
     sector = directory->Find(name);
     if (sector == -1) {
        delete directory;
+#ifdef CHANGED
+       journal->End();
+#endif
        return FALSE;			 // file not found 
     }
+#ifdef CHANGED
+    fileHdr = inodeTable->Get(sector);	// open files see it emptied
+    inodeTable->Detach(sector);		// before the sector can be reused
+#else
     fileHdr = new FileHeader;
     fileHdr->FetchFrom(sector);
+#endif
 
-    freeMap = new BitMap(NumSectors);
-    freeMap->FetchFrom(freeMapFile);
 #ifdef CHANGED
+#ifdef USER_PROGRAM
+    textCache->Purge(sector);		// the sector may be reused
+#endif
+    freeMap = AcquireFreeMap();
     fileHdr->Deallocate(freeMap,0);  		// remove data blocks
+    freeMap->Clear(sector);			// remove header block
+    ReleaseFreeMap();
+    directory->Remove(name);
+
+    directory->WriteBack(directoryFile);        // flush to disk
+    inodeTable->Release(sector, fileHdr);
+    journal->End();
     #else
+    freeMap = new BitMap(NumSectors);
+    freeMap->FetchFrom(freeMapFile);
     fileHdr->Deallocate(freeMap);
-    #endif
 
     freeMap->Clear(sector);			// remove header block
     directory->Remove(name);
 
     freeMap->WriteBack(freeMapFile);		// flush to disk
     directory->WriteBack(directoryFile);        // flush to disk
+    delete freeMap;
     delete fileHdr;
+    #endif
     delete directory;
-    delete freeMap;
     return TRUE;
 } 
 
@@ -430,7 +520,9 @@ FileSystem::Print()
 {
     FileHeader *bitHdr = new FileHeader;
     FileHeader *dirHdr = new FileHeader;
+#ifndef CHANGED
     BitMap *freeMap = new BitMap(NumSectors);
+#endif
     Directory *directory = new Directory(NumDirEntries);
 
     printf("Bit map file header:\n");
@@ -441,15 +533,21 @@ FileSystem::Print()
     dirHdr->FetchFrom(DirectorySector);
     dirHdr->Print();
 
+#ifdef CHANGED
+    residentFreeMap->Print();		// the file may be behind it
+#else
     freeMap->FetchFrom(freeMapFile);
     freeMap->Print();
+#endif
 
     directory->FetchFrom(directoryFile);
     directory->Print();
 
     delete bitHdr;
     delete dirHdr;
+#ifndef CHANGED
     delete freeMap;
+#endif
     delete directory;
 } 
 
@@ -558,13 +656,23 @@ bool FileSystem::CreateDirectory(const char *name) {
     // Create the new folder and writes a data structure to Directory
     Directory *directory;
 
-    Create(name, FileHeader::DIRECTORY);
+    journal->Begin(MaxTransaction);	// the whole new directory
+    if (!Create(name, FileHeader::DIRECTORY)) {
+        journal->End();
+        return false;
+    }
 
     directory = new Directory(NumDirEntries);
 
     OpenFile* newDirectory = Open(name);  //Open 'name' file for reading and writing.  
 
-    directory->WriteBack(newDirectory);    // Write modifications to the newDirectory back to disk
+    if (!directory->WriteBack(newDirectory)) {	// the disk is full
+        delete directory;
+        delete newDirectory;
+        Remove(name);
+        journal->End();
+        return false;
+    }
 
     delete directory;
 
@@ -640,6 +748,7 @@ bool FileSystem::CreateDirectory(const char *name) {
     delete directory;
 
     Directory_path("../");
+    journal->End();
 
     return true;
 }
@@ -689,6 +798,7 @@ void FileSystem:: DeleteDirectory (const char *name)
     //success= TRUE;
 
    
+    journal->Begin(SmallOpReserve);
     directory = new Directory(NumDirEntries);
     directory->FetchFrom(directoryFile);
      Directory_path((std::string(name) + "/").c_str());
@@ -706,32 +816,26 @@ void FileSystem:: DeleteDirectory (const char *name)
     if (sector == -1) {
        delete directory;
        printf("cannot rm '%s': No such file or directory\n", name);
+       journal->End();
        return;
     }
-    fileHdr = new FileHeader;
-    fileHdr->FetchFrom(sector);
+    fileHdr = inodeTable->Get(sector);
+    inodeTable->Detach(sector);
 
-    freeMap = new BitMap(NumSectors);
-    freeMap->FetchFrom(freeMapFile);
-
-    #ifdef CHANGED
+    freeMap = AcquireFreeMap();
     fileHdr->Deallocate(freeMap,0);         // remove data blocks
-    #else
-    fileHdr->Deallocate(freeMap);
-    #endif
-    
     freeMap->Clear(sector);         // remove header block
+    ReleaseFreeMap();
     directory->Remove(name);
 
-    freeMap->WriteBack(freeMapFile);        // flush to disk
     directory->WriteBack(directoryFile);        // flush to disk
-    delete fileHdr;
+    inodeTable->Release(sector, fileHdr);
     delete directory;
-    delete freeMap;
     
     }
     else 
         printf("Can't delete as directory is not empty \n");
+    journal->End();
 
 // /return success;
 
@@ -742,4 +846,181 @@ FileSystem::FreeMap()
     return freeMapFile;
 }
 
+//----------------------------------------------------------------------
+// FileSystem::~FileSystem
+// 	Commit what the journal has not committed yet, the free sector
+//	map included, and write everything home: the log is left empty.
+//----------------------------------------------------------------------
+
+FileSystem::~FileSystem()
+{
+    journal->Checkpoint();
+    delete residentFreeMap;
+    delete heldFrees;
+    delete committedFrees;
+    delete freeMapLock;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::AcquireFreeMap
+// 	Lock the free sector map and return it, to allocate or free
+//	sectors.  The map is fetched from disk once, when the file system
+//	is mounted, and stays in memory: no 4 KB read and write for every
+//	allocation.  Must not be called again before ReleaseFreeMap, in
+//	particular not around a write that may grow a file.
+//----------------------------------------------------------------------
+
+BitMap *
+FileSystem::AcquireFreeMap()
+{
+    freeMapLock->Acquire();
+    return residentFreeMap;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::ReleaseFreeMap
+// 	Unlock the free sector map.  If it was changed, the next flush
+//	of the buffer cache writes the changed words to the map file.
+//----------------------------------------------------------------------
+
+void
+FileSystem::ReleaseFreeMap()
+{
+    bool dirty = residentFreeMap->IsDirty();
+
+    freeMapLock->Release();
+    if (dirty)
+	bufferCache->ScheduleFlush();
+}
+
+//----------------------------------------------------------------------
+// FileSystem::SyncFreeMap
+// 	Write the words of the free sector map changed since the last
+//	call to the map file (into the buffer cache), the sectors freed
+//	since then written free: they go to disk in the transaction that
+//	frees them.  The map file never grows, so writing it does not
+//	lock the map a second time.
+//----------------------------------------------------------------------
+
+void
+FileSystem::SyncFreeMap()
+{
+    freeMapLock->Acquire();
+    residentFreeMap->WriteBackDirty(freeMapFile);
+    freeMapLock->Release();
+}
+
+//----------------------------------------------------------------------
+// FileSystem::CommitFrees
+// 	Called by the journal once a transaction is committed.  The
+//	sectors it freed are free on disk now, but still set in the free
+//	sector map: a recovery could write an old copy of them from the
+//	log over their next contents.  Keep them until the log is emptied.
+//----------------------------------------------------------------------
+
+void
+FileSystem::CommitFrees()
+{
+    freeMapLock->Acquire();
+    for (int i = 0; i < NumSectors; i++)
+	if (heldFrees->Test(i))
+	    committedFrees->Mark(i);
+    freeMapLock->Release();
+}
+
+//----------------------------------------------------------------------
+// FileSystem::ReleaseFrees
+// 	Called by the journal once the log is emptied: clear the sectors
+//	freed by the committed transactions in the free sector map, so
+//	they can be allocated again.  They are free on disk already.
+//----------------------------------------------------------------------
+
+void
+FileSystem::ReleaseFrees()
+{
+    BitMap *freeMap = AcquireFreeMap();
+
+    freeMap->DeferClears(NULL);
+    for (int i = 0; i < NumSectors; i++)
+	if (committedFrees->Test(i)) {
+	    freeMap->Clear(i);
+	    heldFrees->Clear(i);
+	    committedFrees->Clear(i);
+	}
+    freeMap->DeferClears(heldFrees);
+    ReleaseFreeMap();
+}
+
+//----------------------------------------------------------------------
+// FileSystem::HeaderGoal
+// 	Return where to look for a free sector to hold the header of a new
+//	file of type "type", created in the current directory: where the
+//	data of the directory goes, see DataGoal.
+//
+//	A new directory goes to the nearest group with at least the
+//	average number of free sectors instead if the group there has
+//	fewer than half of it: its files would not have room next to it.
+//	Not to the emptiest group, whose seeks to the parent and to the
+//	log may be long.
+//
+//	Without group placement, return 0: the lowest free sector.
+//----------------------------------------------------------------------
+
+int
+FileSystem::HeaderGoal(BitMap *freeMap, FileHeader::FileType type)
+{
+    int goal, home, average, distance, group;
+
+    if (!groupPlacement)
+	return 0;
+    goal = DataGoal(directoryFile->fileSector());
+    home = goal / SectorsPerGroup;
+    average = freeMap->NumClear() / NumGroups;
+    if (type != FileHeader::DIRECTORY
+	|| freeMap->NumClearIn(home * SectorsPerGroup, SectorsPerGroup)
+	   >= average / 2)
+	return goal;
+    for (distance = 1; distance < NumGroups; distance++)
+	for (group = home - distance; group <= home + distance;
+	     group += 2 * distance)
+	    if (group >= 0 && group < NumGroups
+		&& freeMap->NumClearIn(group * SectorsPerGroup,
+				       SectorsPerGroup) >= average)
+		return group * SectorsPerGroup;
+    return goal;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::DataGoal
+// 	Return where the data of the file whose header is in sector
+//	"headerSector" should start: right after the header, in the same
+//	group.
+//
+//	The headers of the free map and of the root directory are at the
+//	start of the disk, but their data, and so the top of the tree,
+//	start in the group next to the log: every transaction writes the
+//	log, and the free map when it commits, so the disk head keeps
+//	coming back there.  With the lowest free sectors, the files are
+//	at the other end of the disk, a full seek away.
+//
+//	No sector is skipped for rotational interleaving: with this disk
+//	(see Disk::ComputeLatency) a gap costs a rotation time instead of
+//	saving one.  A read of the sector following the previous one is
+//	served by the track buffer, and the buffer cache writes
+//	consecutive sectors in a single request.  Only separate writes of
+//	consecutive sectors would miss a revolution, and they are rare.
+//
+//	Without group placement, return 0: the lowest free sectors.
+//----------------------------------------------------------------------
+
+int
+FileSystem::DataGoal(int headerSector)
+{
+    if (!groupPlacement || headerSector < 0)
+	return 0;
+    if (headerSector == FreeMapSector || headerSector == DirectorySector)
+	return LogGroup * SectorsPerGroup;
+    return headerSector + 1;
+}
+
 #endif
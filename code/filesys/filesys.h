@@ -42,10 +42,27 @@
 #include "filehdr.h"
 #include <string>
 
+#ifdef CHANGED
+class BitMap;
+class Lock;
+#endif
+
 
 #define FreeMapSector     0
 #define DirectorySector   1
 
+#ifdef CHANGED
+// The disk is divided into allocation groups of consecutive tracks.  The
+// header and the data of a file go next to its directory, in the same
+// group unless that group is much fuller than the others, and the top of
+// the tree starts in the group next to the log (see journal.h): what is
+// used together is at most a few tracks apart.
+#define TracksPerGroup	8
+#define NumGroups	(NumTracks / TracksPerGroup)
+#define SectorsPerGroup	(TracksPerGroup * SectorsPerTrack)
+#define LogGroup	((LogStart - 1) / SectorsPerGroup)
+#endif
+
 #ifdef CHANGED
 typedef struct {
   char *name;
@@ -121,6 +138,25 @@ class FileSystem {
      void   ChangeDirectory(const  char* filename); 
      OpenFile *FreeMap();
      void DeleteDirectory (const char *name);
+
+    ~FileSystem();			// Checkpoint the journal
+    BitMap *AcquireFreeMap();		// Lock the free sector map, which
+					// stays in memory, and return it
+    void ReleaseFreeMap();		// Unlock it.  Changes are written
+					// back later, by SyncFreeMap
+    void SyncFreeMap();			// Write the changed part of the map
+					// to its file
+    static void SetGroupPlacement(bool on) { groupPlacement = on; }
+					// Place new files, and those of a
+					// disk formatted next, in allocation
+					// groups (the default), or in the
+					// lowest free sectors
+    int DataGoal(int headerSector);	// Where the data of the file with
+					// header "headerSector" should go
+    void CommitFrees();			// The sectors freed so far are
+					// committed by the journal
+    void ReleaseFrees();		// The log is empty: let the sectors
+					// committed free be reused
   #endif
 
   private:
@@ -130,6 +166,15 @@ class FileSystem {
 					// file names, represented as a file
 #ifdef CHANGED
     Program programs[16];
+    BitMap *residentFreeMap;		// contents of freeMapFile
+    Lock *freeMapLock;			// protects residentFreeMap, and the
+					// sectors freed below
+    BitMap *heldFrees;			// freed, kept until the log is emptied
+    BitMap *committedFrees;		// those freed by committed transactions
+    static bool groupPlacement;
+    int HeaderGoal(BitMap *freeMap, FileHeader::FileType type);
+					// Where the header of a new file of
+					// "type" should go
 #endif
 };
 
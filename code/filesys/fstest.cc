@@ -7,6 +7,10 @@
 //	   Perftest -- a stress test for the Nachos file system
 //		read and write a really large file in tiny chunks
 //		(won't work on baseline system!)
+//	   DiskScheduleTest -- compare the seek time of the disk request
+//		schedules, with threads reading random sectors
+//	   SmallFileTest -- compare the seek time of the block placement
+//		policies, with small files in several directories
 //
 // Copyright (c) 1992-1993 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation 
@@ -20,6 +24,9 @@
 #include "thread.h"
 #include "disk.h"
 #include "stats.h"
+#if defined(CHANGED) && defined(USER_PROGRAM)
+#include "userthread.h"
+#endif
 
 #define TransferSize 	10 	// make it small, just to be difficult
 
@@ -238,4 +245,176 @@ void nachcopy(const char *file1, const char *file2)
 
     return;
 }
+
+//----------------------------------------------------------------------
+// DiskScheduleTest
+// 	Have SchedThreads threads read SchedReads random sectors each,
+//	straight from the disk, once with each disk schedule, and print
+//	how long the disk spent seeking.  All the threads are waiting
+//	for the disk most of the time, so the schedule has a choice.
+//
+//	Both schedules read the same sectors.  On a freshly formatted
+//	disk, FIFO seeks for 1250000 ticks (3446440 in all), C-LOOK for
+//	558000 (2570000 in all).
+//----------------------------------------------------------------------
+
+#define SchedThreads	8
+#define SchedReads	16
+
+static int schedSectors[SchedThreads][SchedReads];
+static Semaphore *schedDone;
+
+static void
+SchedReader(int arg)
+{
+#ifdef USER_PROGRAM
+    int which = ((ThreadParam *) arg)->arg;
+#else
+    int which = arg;
+#endif
+    char data[SectorSize];
+
+    for (int i = 0; i < SchedReads; i++)
+	synchDisk->ReadSector(schedSectors[which][i], data);
+    schedDone->V();
+}
+
+void
+DiskScheduleTest()
+{
+    SynchDisk::Schedule schedules[2] = { SynchDisk::FIFO, SynchDisk::CLOOK };
+    const char *names[2] = { "FIFO", "C-LOOK" };
+    int s, t, i;
+
+    for (t = 0; t < SchedThreads; t++)
+	for (i = 0; i < SchedReads; i++)
+	    schedSectors[t][i] = Random() % NumSectors;
+    schedDone = new Semaphore("disk readers done", 0);
+
+    printf("Disk scheduling test: %d threads, %d random reads each\n",
+	   SchedThreads, SchedReads);
+    for (s = 0; s < 2; s++) {
+	long long seekTicks = stats->numSeekTicks;
+	long long ticks = stats->totalTicks;
+
+	synchDisk->SetSchedule(schedules[s]);
+	for (t = 0; t < SchedThreads; t++) {
+	    Thread *reader = new Thread("disk reader");
+#ifdef USER_PROGRAM
+	    ThreadParam *threadParam = new ThreadParam();
+	    threadParam->isProcess = true;	// no address space
+	    threadParam->arg = t;
+	    reader->Fork(SchedReader, (int) threadParam);
+#else
+	    reader->Fork(SchedReader, t);
+#endif
+	}
+	for (t = 0; t < SchedThreads; t++)
+	    schedDone->P();
+	printf("%s: seek ticks %lld, total ticks %lld\n", names[s],
+	       stats->numSeekTicks - seekTicks, stats->totalTicks - ticks);
+    }
+    synchDisk->SetSchedule(SynchDisk::CLOOK);
+    delete schedDone;
+}
+
+//----------------------------------------------------------------------
+// SmallFileTest
+// 	Create SmallFiles files of SmallFileSize bytes in each of SmallDirs
+//	directories, in turn as an archive being unpacked would, then
+//	read them back with an empty buffer cache, one directory after
+//	the other.  Do it once taking the lowest free sectors, and once
+//	with allocation groups, and print how long the disk spent seeking
+//	in each phase.
+//
+//	Each time, the disk is formatted first, with the policy being
+//	measured (it places the free map and the root directory too), and
+//	AgeFiles small files are created in the root directory, and every
+//	other one removed, so that the free space is fragmented as on a
+//	disk that has been in use.  The files of the disk are lost.
+//----------------------------------------------------------------------
+
+#define SmallDirs	4
+#define SmallFiles	8
+#define SmallFileSize	300
+#define AgeFiles	40
+
+static void
+SmallFileCreate(const char *name, char *data)
+{
+    OpenFile *openFile;
+
+    ASSERT(fileSystem->Create(name));
+    openFile = fileSystem->Open(name);
+    ASSERT(openFile != NULL);
+    ASSERT(openFile->Write(data, SmallFileSize) == SmallFileSize);
+    delete openFile;
+}
+
+void
+SmallFileTest()
+{
+    const char *names[2] = { "lowest free", "groups" };
+    char data[SmallFileSize];
+    char name[FileNameMaxLen + 1], path[FileNameMaxLen + 2];
+    OpenFile *openFile;
+    long long seekTicks, ticks;
+    int p, d, f;
+
+    for (f = 0; f < SmallFileSize; f++)
+	data[f] = 'a' + f % 26;
+    printf("Small file test: %d directories of %d files of %d bytes\n",
+	   SmallDirs, SmallFiles, SmallFileSize);
+    for (p = 0; p < 2; p++) {
+	FileSystem::SetGroupPlacement(p == 1);
+	journal->Checkpoint();		// nothing left for the old file
+	formatfilesys();		// system to write
+	for (f = 0; f < AgeFiles; f++) {
+	    sprintf(name, "age%d", f);
+	    SmallFileCreate(name, data);
+	}
+	for (f = 1; f < AgeFiles; f += 2) {
+	    sprintf(name, "age%d", f);
+	    fileSystem->Remove(name);
+	}
+
+	seekTicks = stats->numSeekTicks;
+	ticks = stats->totalTicks;
+	for (d = 0; d < SmallDirs; d++) {
+	    sprintf(name, "%c%d", "lg"[p], d);
+	    fileSystem->CreateDirectory(name);
+	}
+	for (f = 0; f < SmallFiles; f++)
+	    for (d = 0; d < SmallDirs; d++) {
+		sprintf(path, "%c%d/", "lg"[p], d);
+		fileSystem->Directory_path(path);
+		sprintf(name, "s%d", f);
+		SmallFileCreate(name, data);
+		fileSystem->Directory_path("../");
+	    }
+	journal->Checkpoint();		// write everything home now, not
+					// while reading back
+	printf("%s: create seek ticks %lld, total ticks %lld\n", names[p],
+	       stats->numSeekTicks - seekTicks, stats->totalTicks - ticks);
+
+	bufferCache->Invalidate();
+	seekTicks = stats->numSeekTicks;
+	ticks = stats->totalTicks;
+	for (d = 0; d < SmallDirs; d++) {
+	    sprintf(path, "%c%d/", "lg"[p], d);
+	    fileSystem->Directory_path(path);
+	    for (f = 0; f < SmallFiles; f++) {
+		sprintf(name, "s%d", f);
+		openFile = fileSystem->Open(name);
+		ASSERT(openFile != NULL);
+		ASSERT(openFile->Read(data, SmallFileSize) == SmallFileSize);
+		delete openFile;
+	    }
+	    fileSystem->Directory_path("../");
+	}
+	printf("%s: read seek ticks %lld, total ticks %lld\n", names[p],
+	       stats->numSeekTicks - seekTicks, stats->totalTicks - ticks);
+    }
+    FileSystem::SetGroupPlacement(TRUE);
+}
 #endif
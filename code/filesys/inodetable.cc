@@ -0,0 +1,148 @@
+// inodetable.cc
+//	Routines to share the headers of the open files.
+//
+//	Headers are reference counted.  Changes to a header are still
+//	written back by whoever makes them, into the buffer cache, so
+//	the last Release has nothing left to write and only frees the
+//	memory.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifdef CHANGED
+
+#include "copyright.h"
+#include "system.h"
+#include "inodetable.h"
+
+//----------------------------------------------------------------------
+// InodeTable::InodeTable
+// 	Initialize an empty table.
+//----------------------------------------------------------------------
+
+InodeTable::InodeTable()
+{
+    for (int i = 0; i < InodeBuckets; i++)
+	bucket[i] = NULL;
+    detached = NULL;
+    lock = new Lock("inode table");
+}
+
+//----------------------------------------------------------------------
+// InodeTable::~InodeTable
+// 	Free the headers of the files still open (the free map and the
+//	directory files are never closed).
+//----------------------------------------------------------------------
+
+InodeTable::~InodeTable()
+{
+    for (int i = 0; i < InodeBuckets; i++)
+	while (bucket[i] != NULL) {
+	    Inode *inode = bucket[i];
+
+	    bucket[i] = inode->next;
+	    delete inode->hdr;
+	    delete inode;
+	}
+    while (detached != NULL) {
+	Inode *inode = detached;
+
+	detached = inode->next;
+	delete inode->hdr;
+	delete inode;
+    }
+    delete lock;
+}
+
+//----------------------------------------------------------------------
+// InodeTable::Get
+// 	Return the header stored at "sector", shared with the other users
+//	of the file.  The header is read from disk when the file was not
+//	in use.  The lock is kept during the read, so that two threads
+//	opening the same file cannot both read it.
+//----------------------------------------------------------------------
+
+FileHeader *
+InodeTable::Get(int sector)
+{
+    Inode *inode;
+
+    lock->Acquire();
+    for (inode = bucket[sector % InodeBuckets]; inode != NULL;
+	 inode = inode->next)
+	if (inode->sector == sector)
+	    break;
+    if (inode == NULL) {
+	inode = new Inode;
+	inode->sector = sector;
+	inode->refCount = 0;
+	inode->hdr = new FileHeader;
+	inode->hdr->FetchFrom(sector);
+	inode->next = bucket[sector % InodeBuckets];
+	bucket[sector % InodeBuckets] = inode;
+	DEBUG('f', "Inode of sector %d loaded\n", sector);
+    }
+    inode->refCount++;
+    lock->Release();
+    return inode->hdr;
+}
+
+//----------------------------------------------------------------------
+// InodeTable::Release
+// 	Drop one reference to "hdr", the header stored at "sector", and
+//	forget the header when it was the last one.
+//----------------------------------------------------------------------
+
+void
+InodeTable::Release(int sector, FileHeader *hdr)
+{
+    Inode **link;
+
+    lock->Acquire();
+    for (link = &bucket[sector % InodeBuckets]; *link != NULL;
+	 link = &(*link)->next)
+	if ((*link)->hdr == hdr)
+	    break;
+    if (*link == NULL)			// the file was removed
+	for (link = &detached; *link != NULL; link = &(*link)->next)
+	    if ((*link)->hdr == hdr)
+		break;
+    ASSERT(*link != NULL);
+    if (--(*link)->refCount == 0) {
+	Inode *inode = *link;
+
+	*link = inode->next;
+	delete inode->hdr;
+	delete inode;
+	DEBUG('f', "Inode of sector %d released\n", sector);
+    }
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// InodeTable::Detach
+// 	Take the header stored at "sector" out of the hash table, if it
+//	is in use.  Its users keep it until they release it.
+//----------------------------------------------------------------------
+
+void
+InodeTable::Detach(int sector)
+{
+    Inode **link;
+
+    lock->Acquire();
+    for (link = &bucket[sector % InodeBuckets]; *link != NULL;
+	 link = &(*link)->next)
+	if ((*link)->sector == sector) {
+	    Inode *inode = *link;
+
+	    *link = inode->next;
+	    inode->next = detached;
+	    detached = inode;
+	    break;
+	}
+    lock->Release();
+}
+
+#endif // CHANGED
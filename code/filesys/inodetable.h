@@ -0,0 +1,60 @@
+// inodetable.h
+//	Data structures for the kernel table of open file headers.
+//
+//	Every OpenFile of a file shares the same in-memory FileHeader,
+//	found in the inode table by the sector of the header.  The
+//	header stays in memory, with the index sectors it has read, as
+//	long as the file is open anywhere: translating an offset of the
+//	file to a sector costs no I/O, and a file grown through one
+//	OpenFile is seen grown through all the others.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifdef CHANGED
+
+#ifndef INODETABLE_H
+#define INODETABLE_H
+
+#include "copyright.h"
+#include "filehdr.h"
+#include "synch.h"
+
+#define InodeBuckets	31		// size of the hash table
+
+// A file header in use
+class Inode {
+  public:
+    int sector;			// where the header is on disk
+    int refCount;		// number of users of "hdr"
+    FileHeader *hdr;
+    Inode *next;		// next inode in the same hash chain
+};
+
+class InodeTable {
+  public:
+    InodeTable();
+    ~InodeTable();
+
+    FileHeader *Get(int sector);	// Return the header stored at
+					// "sector", reading it only if
+					// nobody uses it yet
+    void Release(int sector, FileHeader *hdr);
+					// Done with "hdr", got from
+					// Get(sector)
+    void Detach(int sector);		// The file is being removed: its
+					// header sector may be reused by
+					// another file, for which Get must
+					// not return the old header
+
+  private:
+    Inode *bucket[InodeBuckets];	// first inode of each hash chain
+    Inode *detached;			// inodes of removed files still
+					// open, chained through "next"
+    Lock *lock;				// protects the table
+};
+
+#endif // INODETABLE_H
+
+#endif // CHANGED
@@ -0,0 +1,331 @@
+// journal.cc
+//	Routines to log the changes to the file system metadata, and to
+//	replay them after a crash.
+//
+//	The log area is written from its start, one transaction after the
+//	other, and started over at each checkpoint.  Appending to it is a
+//	sequential write, whatever the sectors logged; a transaction that
+//	would not fit first forces a checkpoint.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifdef CHANGED
+
+#include "copyright.h"
+#include "system.h"
+#include "journal.h"
+
+//----------------------------------------------------------------------
+// Journal::Journal
+// 	Initialize a journal with no operation in progress.  Format or
+//	Recover tell where the log stands.
+//----------------------------------------------------------------------
+
+Journal::Journal()
+{
+    lock = new Lock("journal");
+    changed = new Condition("journal changed");
+    active = 0;
+    reserved = 0;
+    committing = FALSE;
+    sequence = firstSequence = 1;
+    head = 1;
+    sectors = new int[MaxLogged];
+    record = new char[(MaxLogged + 1) * SectorSize];
+    buffers = new char *[MaxLogged + 1];
+    for (int i = 0; i <= MaxLogged; i++)
+	buffers[i] = &record[i * SectorSize];
+}
+
+Journal::~Journal()
+{
+    delete lock;
+    delete changed;
+    delete [] sectors;
+    delete [] record;
+    delete [] buffers;
+}
+
+//----------------------------------------------------------------------
+// Journal::Format
+// 	Write the header of an empty log.  The caller has marked the log
+//	area in use in the free sector map.
+//----------------------------------------------------------------------
+
+void
+Journal::Format()
+{
+    sequence = firstSequence = 1;
+    head = 1;
+    WriteHeader();
+}
+
+//----------------------------------------------------------------------
+// Journal::Recover
+// 	Copy the sectors of the transactions found in the log to their
+//	home location, in the order they were committed, then start the
+//	log over.  A transaction whose commit sector is missing, or
+//	belongs to an older round of the log, was not committed: the
+//	replay stops there.  Called before anything is read from the
+//	file system.
+//
+//	A disk without a log header has not been formatted yet: Nachos
+//	mounts it before "-f" formats it.  There is nothing to replay.
+//----------------------------------------------------------------------
+
+void
+Journal::Recover()
+{
+    LogRecord *rec = (LogRecord *) record;
+    int n, i, replayed = 0;
+
+    synchDisk->ReadSector(LogStart, record);
+    if (rec->magic != LogHeaderMagic) {
+	DEBUG('f', "No log on the disk, nothing to replay\n");
+	Format();
+	return;
+    }
+    sequence = rec->sequence;
+    for (head = 1; head < LogSectors; head += n + 2) {
+	synchDisk->ReadSector(LogStart + head, record);
+	n = rec->count;
+	if (rec->magic != DescriptorMagic || rec->sequence != sequence
+	    || n <= 0 || n > MaxLogged || head + n + 2 > LogSectors)
+	    break;
+	for (i = 0; i < n; i++)
+	    sectors[i] = rec->sectors[i];
+	synchDisk->ReadSector(LogStart + head + n + 1, record);
+	if (rec->magic != CommitMagic || rec->sequence != sequence)
+	    break;
+	synchDisk->ReadSectors(LogStart + head + 1, n, buffers);
+	for (i = 0; i < n; i++)
+	    synchDisk->WriteSector(sectors[i], buffers[i]);
+	DEBUG('f', "Replayed transaction %d, %d sectors\n", sequence, n);
+	replayed++;
+	sequence++;
+    }
+    if (replayed > 0)
+	printf("Journal: %d transactions replayed\n", replayed);
+    firstSequence = sequence;
+    head = 1;
+    WriteHeader();
+}
+
+//----------------------------------------------------------------------
+// Journal::Begin
+// 	Start an operation of the current thread, which will log at most
+//	"reserve" sectors.  Wait while a commit is going on, or while the
+//	running transaction has no room left; when nobody else is in an
+//	operation to end it, commit it, or checkpoint if the log itself
+//	is full.  An operation started inside another one belongs to the
+//	outer one, and does not wait.
+//----------------------------------------------------------------------
+
+void
+Journal::Begin(int reserve)
+{
+    ASSERT(reserve <= MaxTransaction);
+    if (currentThread->journalDepth > 0) {
+	currentThread->journalDepth++;
+	return;
+    }
+    lock->Acquire();
+    while (committing || reserved + reserve > MaxTransaction
+	   || reserved + reserve > LogRoom()) {
+	if (!committing && active == 0) {
+	    bool logFull = reserved + reserve > LogRoom();
+	    lock->Release();
+	    if (logFull)
+		Checkpoint();
+	    else
+		Commit();
+	    lock->Acquire();
+	} else
+	    changed->Wait(lock);
+    }
+    active++;
+    reserved += reserve;
+    currentThread->journalDepth = 1;
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// Journal::End
+// 	End the operation started by the matching Begin.  The sectors it
+//	logged are committed later, with the rest of the transaction.
+//----------------------------------------------------------------------
+
+void
+Journal::End()
+{
+    ASSERT(currentThread->journalDepth > 0);
+    if (--currentThread->journalDepth > 0)
+	return;
+    lock->Acquire();
+    active--;
+    changed->Broadcast(lock);
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// Journal::InOperation
+// 	Should a sector written now by the current thread be logged?
+//----------------------------------------------------------------------
+
+bool
+Journal::InOperation()
+{
+    return currentThread->journalDepth > 0;
+}
+
+//----------------------------------------------------------------------
+// Journal::Commit
+// 	Let the operations in progress end, then log the sectors of the
+//	running transaction.  Operations wait until it is done.
+//----------------------------------------------------------------------
+
+void
+Journal::Commit()
+{
+    Quiesce();
+    WriteTransaction();
+    Resume();
+}
+
+//----------------------------------------------------------------------
+// Journal::Checkpoint
+// 	Commit, then write every dirty buffer home and empty the log.
+//	Called by the flusher, when the log is full, and when the file
+//	system goes away.  Operations wait until it is done: none of them
+//	may log a sector whose last committed contents are not home yet.
+//----------------------------------------------------------------------
+
+void
+Journal::Checkpoint()
+{
+    Quiesce();
+    WriteTransaction();
+    EmptyLog();
+    Resume();
+}
+
+//----------------------------------------------------------------------
+// Journal::Quiesce, Journal::Resume
+// 	Bracket a commit or a checkpoint.  Quiesce waits for the one
+//	going on, if any, then for the operations in progress to end;
+//	Begin holds back the new ones until Resume.
+//----------------------------------------------------------------------
+
+void
+Journal::Quiesce()
+{
+    lock->Acquire();
+    while (committing)
+	changed->Wait(lock);
+    committing = TRUE;
+    while (active > 0)
+	changed->Wait(lock);
+    lock->Release();
+}
+
+void
+Journal::Resume()
+{
+    lock->Acquire();
+    committing = FALSE;
+    reserved = 0;
+    changed->Broadcast(lock);
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// Journal::LogRoom
+// 	Return how many sectors a transaction started now could log, not
+//	counting the free sector map, before the log area is full.  Room
+//	is kept for one more transaction logging only the map, so that a
+//	checkpoint can always commit first.
+//----------------------------------------------------------------------
+
+int
+Journal::LogRoom()
+{
+    return LogSectors - head - 2 * (MapSectors + 2);
+}
+
+//----------------------------------------------------------------------
+// Journal::WriteTransaction
+// 	Write the descriptor and the contents of the sectors logged by
+//	the running transaction with one request, then its commit sector
+//	with another, and let the buffer cache write them home.  The
+//	changes of the free sector map are logged first, with the rest.
+//----------------------------------------------------------------------
+
+void
+Journal::WriteTransaction()
+{
+    LogRecord *rec = (LogRecord *) record;
+    int n, i;
+
+    currentThread->journalDepth++;
+    if (fileSystem != NULL)		// not while it is being formatted
+	fileSystem->SyncFreeMap();
+    currentThread->journalDepth--;
+
+    n = bufferCache->CollectLogged(sectors, buffers + 1, MaxLogged);
+    if (n == 0)
+	return;
+    ASSERT(head + n + 2 <= LogSectors);	// Begin made room
+
+    rec->magic = DescriptorMagic;
+    rec->sequence = sequence;
+    rec->count = n;
+    for (i = 0; i < n; i++)
+	rec->sectors[i] = sectors[i];
+    synchDisk->WriteSectors(LogStart + head, n + 1, buffers);
+
+    rec->magic = CommitMagic;		// the contents are on disk
+    rec->count = 0;
+    synchDisk->WriteSector(LogStart + head + n + 1, record);
+    DEBUG('f', "Committed transaction %d, %d sectors\n", sequence, n);
+
+    head += n + 2;
+    sequence++;
+    bufferCache->ReleaseLogged();
+    if (fileSystem != NULL)
+	fileSystem->CommitFrees();
+}
+
+//----------------------------------------------------------------------
+// Journal::EmptyLog
+// 	Write every dirty buffer home, so that the log is no longer
+//	needed, and start it over.  The sectors freed by the transactions
+//	committed can then be reused.
+//----------------------------------------------------------------------
+
+void
+Journal::EmptyLog()
+{
+    bufferCache->Flush();
+    if (head == 1)
+	return;				// nothing logged since the last time
+    firstSequence = sequence;
+    head = 1;
+    WriteHeader();
+    if (fileSystem != NULL)
+	fileSystem->ReleaseFrees();
+}
+
+void
+Journal::WriteHeader()
+{
+    LogRecord header;
+
+    bzero((char *) &header, sizeof(header));
+    header.magic = LogHeaderMagic;
+    header.sequence = firstSequence;
+    synchDisk->WriteSector(LogStart, (char *) &header);
+}
+
+#endif // CHANGED
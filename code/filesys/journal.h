@@ -0,0 +1,126 @@
+// journal.h
+//	Data structures for the write-ahead log of the file system
+//	metadata.
+//
+//	The operations that change metadata (file headers, index sectors,
+//	directories, the free sector map) run between Journal::Begin and
+//	Journal::End.  The sectors they write through the buffer cache
+//	are logged: the cache keeps them, and does not write them to
+//	their home location yet.
+//
+//	A commit copies every logged sector to the log area, at the end of
+//	the disk, with a single request: a descriptor sector listing
+//	where they belong, then their contents.  A commit sector follows.
+//	Only then may the cache write the sectors home, lazily, as any
+//	dirty buffer.  Begin commits when the running transaction is
+//	full: everything done in the meantime, by any thread, goes in the
+//	same transaction (group commit).  A commit waits for the
+//	operations in progress to end, and new ones wait for the commit.
+//
+//	The flusher checkpoints: it commits, writes every dirty buffer
+//	home, and empties the log.  So does Begin when the log has no
+//	room left for the running transaction.  After a crash, Recover
+//	copies the transactions whose commit sector is in the log to
+//	their home location.
+//
+//	Sectors freed by a transaction only return to the free sector map
+//	at the checkpoint: until then the log may hold an old copy of
+//	them, which a recovery would write over their next contents.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifdef CHANGED
+
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include "copyright.h"
+#include "disk.h"
+#include "synch.h"
+
+#define LogSectors	(2 * SectorsPerTrack)	// size of the log area
+#define LogStart	(NumSectors - LogSectors)	// its first sector
+#define MapSectors	(NumSectors / 8 / SectorSize)
+					// sectors of the free map file
+#define MaxTransaction	44		// sectors reserved by the operations
+					// of a transaction at most
+#define MaxLogged	(MaxTransaction + MapSectors)
+					// sectors logged by a transaction,
+					// counting the free map
+
+// Sectors an operation may log: a header, the directory sectors holding
+// its entry, or those of the bucket chains a split packs again, the
+// header of the directory, and a few index sectors
+#define SmallOpReserve	12
+
+#define LogHeaderMagic	0x4c4f4748
+#define DescriptorMagic	0x4c4f4744
+#define CommitMagic	0x4c4f4743
+
+// The log header (first sector of the log area), a descriptor and a
+// commit sector all have this layout.  The transactions in the log are
+// numbered from the "sequence" of the header; a descriptor or commit
+// sector belongs to transaction "sequence".
+class LogRecord {
+  public:
+    int magic;
+    int sequence;
+    int count;			// descriptor: number of sectors logged
+    short sectors[(SectorSize - 3 * sizeof(int)) / sizeof(short)];
+				// descriptor: their home location
+};
+
+class Journal {
+  public:
+    Journal();
+    ~Journal();
+
+    void Format();		// Write an empty log (the disk is being
+				// formatted)
+    void Recover();		// Replay the committed transactions found
+				// in the log (the disk is being mounted)
+
+    void Begin(int reserve);	// Start an operation of the current
+				// thread, which logs at most "reserve"
+				// sectors.  Operations nest
+    void End();			// End it
+    static bool InOperation();	// Is the current thread in an operation?
+
+    void Commit();		// Commit the running transaction
+    void Checkpoint();		// Commit, write everything home, and
+				// empty the log
+
+  private:
+    void Quiesce();		// Wait for the operations in progress to
+				// end, and hold back new ones
+    void Resume();		// Let them start again
+    int LogRoom();		// Sectors a transaction started now
+				// could log, besides the free map
+    void WriteTransaction();	// Log the sectors of the running
+				// transaction; operations held back
+    void EmptyLog();		// Write everything home, and start the
+				// log over; operations held back
+    void WriteHeader();
+
+    Lock *lock;			// protects the fields below
+    Condition *changed;		// signaled when an operation ends, or
+				// when a commit or checkpoint is over
+    int active;			// operations in progress
+    int reserved;		// sectors reserved by the running
+				// transaction
+    bool committing;		// is a commit or checkpoint going on?
+    int sequence;		// number of the next transaction
+    int firstSequence;		// number of the first one in the log
+    int head;			// where the next descriptor goes, from
+				// LogStart
+
+    int *sectors;		// home of each logged sector, and their
+    char *record;		// descriptor and contents (commits only)
+    char **buffers;		// &record[i * SectorSize]
+};
+
+#endif // JOURNAL_H
+
+#endif // CHANGED
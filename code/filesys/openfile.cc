@@ -31,11 +31,20 @@
 
 OpenFile::OpenFile(int sector)
 { 
+#ifdef CHANGED
+    hdr = inodeTable->Get(sector);	// shared with the other OpenFiles
+    if (fileSystem != NULL)		// not while it is being mounted
+        hdr->SetAllocationGoal(fileSystem->DataGoal(sector));
+#else
     hdr = new FileHeader;
     hdr->FetchFrom(sector);
+#endif
     seekPosition = 0;
 #ifdef CHANGED
     Sector = sector;
+    nextReadPosition = 0;		// reading from the start is sequential
+    readAhead = 0;
+    prefetched = 0;
 #endif
 }
 
@@ -46,7 +55,11 @@ OpenFile::OpenFile(int sector)
 
 OpenFile::~OpenFile()
 {
+#ifdef CHANGED
+    inodeTable->Release(Sector, hdr);
+#else
     delete hdr;
+#endif
 }
 
 //----------------------------------------------------------------------
@@ -93,9 +106,12 @@ OpenFile::Write(const char *into, int numBytes)
    if (seekPosition < hdr->FileLength()) 
    {
         int left;
-        BitMap *freemap = new BitMap(NumSectors);
-        freemap->FetchFrom(fileSystem->FreeMap());
+        journal->Begin(SmallOpReserve);
+        BitMap *freemap = fileSystem->AcquireFreeMap();
         hdr->Deallocate(freemap,seekPosition);
+        fileSystem->ReleaseFreeMap();
+        hdr->WriteBack(Sector);     // the freed sectors are no longer its
+        journal->End();
         if (hdr->FileLength() % SectorSize)
         {
              left = SectorSize * (1 + (hdr->FileLength() / SectorSize)) - hdr->FileLength();
@@ -140,6 +156,9 @@ OpenFile::ReadAt(char *into, int numBytes, int position)
     int fileLength = hdr->FileLength();
     int i, firstSector, lastSector, numSectors;
     char *buf;
+#ifdef CHANGED
+    int run;
+#endif
 
     if ((numBytes <= 0) || (position >= fileLength))
         return 0;               // check request
@@ -159,16 +178,84 @@ OpenFile::ReadAt(char *into, int numBytes, int position)
 
     // read in all the full and partial sectors that we need
     buf = new char[numSectors * SectorSize];
+#ifdef CHANGED
+    for (i = firstSector; i <= lastSector; i += run) {
+        run = SectorRun(i, lastSector);
+        bufferCache->ReadSectors(hdr->ByteToSector(i * SectorSize), run,
+                    &buf[(i - firstSector) * SectorSize]);
+    }
+#else
     for (i = firstSector; i <= lastSector; i++) 
         synchDisk->ReadSector(hdr->ByteToSector(i * SectorSize), 
                     &buf[(i - firstSector) * SectorSize]);
+#endif
 
     // copy the part we want
     bcopy(&buf[position - (firstSector * SectorSize)], into, numBytes);
     delete [] buf;
+#ifdef CHANGED
+    ReadAhead(position, numBytes, lastSector);
+#endif
     return numBytes;
 }
 
+#ifdef CHANGED
+//----------------------------------------------------------------------
+// OpenFile::ReadAhead
+// 	Called after each ReadAt of "numBytes" at "position", ending in
+//	sector "lastSector" of the file.  If it continues the previous
+//	read, grow the read-ahead window, and ask the buffer cache to
+//	prefetch the sectors of the window not asked for yet; the disk
+//	then reads them while the caller works on what it got.  Any
+//	other read closes the window.
+//----------------------------------------------------------------------
+
+void
+OpenFile::ReadAhead(int position, int numBytes, int lastSector)
+{
+    if (position == nextReadPosition) {
+        readAhead = readAhead == 0 ? 2 : readAhead * 2;
+        if (readAhead > MaxReadAhead)
+            readAhead = MaxReadAhead;
+    } else {
+        readAhead = 0;
+        prefetched = 0;
+    }
+    nextReadPosition = position + numBytes;
+    if (readAhead == 0)
+        return;
+
+    int first = lastSector + 1 > prefetched ? lastSector + 1 : prefetched;
+    int last = lastSector + readAhead;
+    int fileSectors = divRoundUp(hdr->FileLength(), SectorSize);
+    if (last >= fileSectors)
+        last = fileSectors - 1;
+    for (int i = first; i <= last; i++)
+        bufferCache->Prefetch(hdr->ByteToSector(i * SectorSize));
+    if (last >= first)
+        prefetched = last + 1;
+}
+
+//----------------------------------------------------------------------
+// OpenFile::SectorRun
+// 	Return how many sectors of the file, starting with sector "first"
+//	and up to sector "last", are stored in consecutive disk sectors,
+//	so that ReadAt and WriteAt can transfer them together.
+//----------------------------------------------------------------------
+
+int
+OpenFile::SectorRun(int first, int last)
+{
+    int start = hdr->ByteToSector(first * SectorSize);
+    int n = 1;
+
+    while (first + n <= last
+	   && hdr->ByteToSector((first + n) * SectorSize) == start + n)
+        n++;
+    return n;
+}
+#endif
+
 int
 OpenFile::WriteAt(const char *from, int numBytes, int position)
 {
@@ -176,20 +263,30 @@ OpenFile::WriteAt(const char *from, int numBytes, int position)
     int i, firstSector, lastSector, numSectors;
     bool firstAligned, lastAligned;
     char *buf;
+#ifdef CHANGED
+    int run;
+#endif
 
 #ifdef CHANGED
     if ((numBytes <= 0) || (position > fileLength))
     return 0;               // check request
+#ifdef USER_PROGRAM
+    textCache->Purge(Sector);	// in case this is an executable
+#endif
     if ((position + numBytes) > fileLength)
     {
     int extendsize = position + numBytes - fileLength;
-        BitMap *freemap = new BitMap(NumSectors);
-        freemap->FetchFrom(fileSystem->FreeMap());
-        if(hdr->Allocate(freemap,extendsize) == FALSE)
+        // the header, and at most every index sector of the file
+        journal->Begin(2 + divRoundUp(position + numBytes,
+                                      SectorSize * MaxPerSector));
+        BitMap *freemap = fileSystem->AcquireFreeMap();
+        bool extended = hdr->Allocate(freemap,extendsize);
+        fileSystem->ReleaseFreeMap();
+        if (extended)
+            hdr->WriteBack(Sector);
+        journal->End();
+        if(extended == FALSE)
            return 0;
-        hdr->WriteBack(Sector);
-        freemap->WriteBack(fileSystem->FreeMap());
-        delete freemap;
     }   
 #else
     if ((numBytes <= 0) || (position >= fileLength))
@@ -220,9 +317,17 @@ OpenFile::WriteAt(const char *from, int numBytes, int position)
     bcopy(from, &buf[position - (firstSector * SectorSize)], numBytes);
 
 // write modified sectors back
+#ifdef CHANGED
+    for (i = firstSector; i <= lastSector; i += run) {
+        run = SectorRun(i, lastSector);
+        bufferCache->WriteSectors(hdr->ByteToSector(i * SectorSize), run,
+                    &buf[(i - firstSector) * SectorSize]);
+    }
+#else
     for (i = firstSector; i <= lastSector; i++) 
         synchDisk->WriteSector(hdr->ByteToSector(i * SectorSize), 
                     &buf[(i - firstSector) * SectorSize]);
+#endif
     delete [] buf;
     return numBytes;
 }
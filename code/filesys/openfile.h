@@ -94,9 +94,26 @@ class OpenFile {
     int seekPosition;			// Current position within the file
 #ifdef CHANGED
     int Sector;
+
+    // Read-ahead: while the file is read sequentially, the sectors
+    // following each read are prefetched into the buffer cache, in a
+    // window that doubles with each sequential read
+    void ReadAhead(int position, int numBytes, int lastSector);
+    int nextReadPosition;		// where a sequential read starts
+    int readAhead;			// size of the window, in sectors
+    int prefetched;			// first sector of the file not
+					// prefetched yet
+
+    int SectorRun(int first, int last);	// how many sectors of the file,
+					// from "first" to at most "last",
+					// follow each other on disk
 #endif
 };
 
+#ifdef CHANGED
+#define MaxReadAhead	8		// largest read-ahead window
+#endif
+
 #endif // FILESYS
 
 #endif // OPENFILE_H
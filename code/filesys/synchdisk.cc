@@ -10,12 +10,24 @@
 //	handle one operation at a time, use a lock to enforce mutual
 //	exclusion.
 //
+//	(CHANGED) Instead of the lock, requests that find the disk busy
+//	wait in a queue, and the interrupt handler starts the next one.
+//	With the CLOOK schedule, the next one is the request with the
+//	nearest sector ahead of the head, or the lowest sector when there
+//	is none ahead: the head sweeps the disk in one direction instead
+//	of seeking back and forth in arrival order.  The queue is shared
+//	with the interrupt handler, so it is protected by disabling
+//	interrupts.
+//
 // Copyright (c) 1992-1993 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation 
 // of liability and disclaimer of warranty provisions.
 
 #include "copyright.h"
 #include "synchdisk.h"
+#ifdef CHANGED
+#include "system.h"
+#endif
 
 //----------------------------------------------------------------------
 // DiskRequestDone
@@ -42,8 +54,15 @@ DiskRequestDone (int arg)
 
 SynchDisk::SynchDisk(const char* name)
 {
+#ifdef CHANGED
+    schedule = CLOOK;
+    active = NULL;
+    queue = NULL;
+    headSector = 0;
+#else
     semaphore = new Semaphore("synch disk", 0);
     lock = new Lock("synch disk lock");
+#endif
     disk = new Disk(name, DiskRequestDone, (int) this);
 }
 
@@ -56,8 +75,10 @@ SynchDisk::SynchDisk(const char* name)
 SynchDisk::~SynchDisk()
 {
     delete disk;
+#ifndef CHANGED
     delete lock;
     delete semaphore;
+#endif
 }
 
 //----------------------------------------------------------------------
@@ -72,10 +93,14 @@ SynchDisk::~SynchDisk()
 void
 SynchDisk::ReadSector(int sectorNumber, char* data)
 {
+#ifdef CHANGED
+    Transfer(sectorNumber, 1, &data, FALSE);
+#else
     lock->Acquire();			// only one disk I/O at a time
     disk->ReadRequest(sectorNumber, data);
     semaphore->P();			// wait for interrupt
     lock->Release();
+#endif
 }
 
 //----------------------------------------------------------------------
@@ -90,10 +115,14 @@ SynchDisk::ReadSector(int sectorNumber, char* data)
 void
 SynchDisk::WriteSector(int sectorNumber, char* data)
 {
+#ifdef CHANGED
+    Transfer(sectorNumber, 1, &data, TRUE);
+#else
     lock->Acquire();			// only one disk I/O at a time
     disk->WriteRequest(sectorNumber, data);
     semaphore->P();			// wait for interrupt
     lock->Release();
+#endif
 }
 
 //----------------------------------------------------------------------
@@ -105,5 +134,132 @@ SynchDisk::WriteSector(int sectorNumber, char* data)
 void
 SynchDisk::RequestDone()
 { 
+#ifdef CHANGED
+    DiskRequest *done = active;
+
+    active = NULL;
+    if (queue != NULL)
+	StartRequest(NextRequest());	// keep the disk busy
+    done->done->V();
+#else
     semaphore->V();
+#endif
+}
+
+#ifdef CHANGED
+//----------------------------------------------------------------------
+// SynchDisk::ReadSectors/WriteSectors
+// 	Read/write "count" consecutive sectors, starting at "sectorNumber",
+//	with a single disk request.  Sector i of the run goes to (comes
+//	from) buffers[i].  Return only after the transfer is over.
+//----------------------------------------------------------------------
+
+void
+SynchDisk::ReadSectors(int sectorNumber, int count, char **buffers)
+{
+    Transfer(sectorNumber, count, buffers, FALSE);
+}
+
+void
+SynchDisk::WriteSectors(int sectorNumber, int count, char **buffers)
+{
+    Transfer(sectorNumber, count, buffers, TRUE);
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::Transfer
+// 	Read or write sectors: start the request if the disk is idle,
+//	queue it otherwise, and wait until it is done.
+//----------------------------------------------------------------------
+
+void
+SynchDisk::Transfer(int sectorNumber, int count, char **buffers,
+		    bool writing)
+{
+    DiskRequest request;
+    IntStatus oldLevel;
+
+    request.sector = sectorNumber;
+    request.count = count;
+    request.buffers = buffers;
+    request.writing = writing;
+    request.done = new Semaphore("disk request", 0);
+
+    oldLevel = interrupt->SetLevel(IntOff);
+    if (active == NULL)
+	StartRequest(&request);
+    else
+	Enqueue(&request);
+    (void) interrupt->SetLevel(oldLevel);
+
+    request.done->P();			// wait for interrupt
+    delete request.done;
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::StartRequest
+// 	Send "request" to the disk.  Interrupts are off.
+//----------------------------------------------------------------------
+
+void
+SynchDisk::StartRequest(DiskRequest *request)
+{
+    active = request;
+    headSector = request->sector;
+    if (request->count > 1) {
+	if (request->writing)
+	    disk->WriteMultiple(request->sector, request->count,
+				request->buffers);
+	else
+	    disk->ReadMultiple(request->sector, request->count,
+			       request->buffers);
+    } else if (request->writing)
+	disk->WriteRequest(request->sector, request->buffers[0]);
+    else
+	disk->ReadRequest(request->sector, request->buffers[0]);
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::Enqueue
+// 	Put "request" in the queue: at the end for FIFO, after the
+//	requests for lower or equal sectors for CLOOK.  Interrupts are
+//	off.
+//----------------------------------------------------------------------
+
+void
+SynchDisk::Enqueue(DiskRequest *request)
+{
+    DiskRequest **link = &queue;
+
+    while (*link != NULL &&
+	   (schedule == FIFO || (*link)->sector <= request->sector))
+	link = &(*link)->next;
+    request->next = *link;
+    *link = request;
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::NextRequest
+// 	Remove from the queue, and return, the request to start next:
+//	the oldest one for FIFO.  For CLOOK, the first one at or past the
+//	sector of the last request, or if there is none, the one with
+//	the lowest sector.  Interrupts are off.
+//----------------------------------------------------------------------
+
+DiskRequest *
+SynchDisk::NextRequest()
+{
+    DiskRequest **link = &queue;
+    DiskRequest *request;
+
+    if (schedule == CLOOK) {
+	while (*link != NULL && (*link)->sector < headSector)
+	    link = &(*link)->next;
+	if (*link == NULL)
+	    link = &queue;		// wrap around to the lowest sector
+    }
+    request = *link;
+    *link = request->next;
+    return request;
 }
+#endif
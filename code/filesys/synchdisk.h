@@ -14,6 +14,19 @@
 #include "disk.h"
 #include "synch.h"
 
+#ifdef CHANGED
+// A read or write request, waiting for the disk or being served
+class DiskRequest {
+  public:
+    int sector;			// first sector
+    int count;			// number of consecutive sectors
+    char **buffers;		// where each of them goes or comes from
+    bool writing;
+    Semaphore *done;		// signaled when the transfer is over
+    DiskRequest *next;		// next request in the queue
+};
+#endif
+
 // The following class defines a "synchronous" disk abstraction.
 // As with other I/O devices, the raw physical disk is an asynchronous device --
 // requests to read or write portions of the disk return immediately,
@@ -37,17 +50,48 @@ class SynchDisk {
     					// Disk::ReadRequest/WriteRequest and
 					// then wait until the request is done.
     void WriteSector(int sectorNumber, char* data);
+#ifdef CHANGED
+    void ReadSectors(int sectorNumber, int count, char **buffers);
+    void WriteSectors(int sectorNumber, int count, char **buffers);
+					// Same for "count" consecutive
+					// sectors, in a single disk request
+#endif
     
     void RequestDone();			// Called by the disk device interrupt
 					// handler, to signal that the
 					// current disk operation is complete.
 
+#ifdef CHANGED
+    enum Schedule { FIFO, CLOOK };
+    void SetSchedule(Schedule which) { schedule = which; }
+					// Choose the order in which queued
+					// requests are sent to the disk
+    bool UseMapping() { return disk->UseMapping(); }
+    void Sync() { disk->Sync(); }	// See Disk::UseMapping/Sync
+#endif
+
   private:
     Disk *disk;		  		// Raw disk device
+#ifdef CHANGED
+    void Transfer(int sectorNumber, int count, char **buffers,
+		  bool writing);
+    void StartRequest(DiskRequest *request);
+    void Enqueue(DiskRequest *request);
+    DiskRequest *NextRequest();		// Remove from the queue the request
+					// to start next
+
+    Schedule schedule;
+    DiskRequest *active;		// request being served, or NULL
+    DiskRequest *queue;			// requests waiting for the disk,
+					// sorted by sector for CLOOK, in
+					// arrival order for FIFO
+    int headSector;			// sector of the last request started
+#else
     Semaphore *semaphore; 		// To synchronize requesting thread 
 					// with the interrupt handler
     Lock *lock;		  		// Only one read/write request
 					// can be sent to the disk at a time
+#endif
 };
 
 #endif // SYNCHDISK_H
@@ -50,6 +50,9 @@ Disk::Disk(const char* name, VoidFunctionPtr callWhenDone, int callArg)
     handlerArg = callArg;
     lastSector = 0;
     bufferInit = 0;
+#ifdef CHANGED
+    image = NULL;
+#endif
     
     fileno = OpenForReadWrite(name, FALSE);
     if (fileno >= 0) {		 	// file exists, check magic number 
@@ -75,9 +78,84 @@ Disk::Disk(const char* name, VoidFunctionPtr callWhenDone, int callArg)
 
 Disk::~Disk()
 {
+#ifdef CHANGED
+    if (image != NULL) {
+	Sync();
+	UnmapFile(image, DiskSize);
+    }
+#endif
     Close(fileno);
 }
 
+#ifdef CHANGED
+//----------------------------------------------------------------------
+// Disk::UseMapping
+// 	Map the UNIX file into memory, so that sectors are moved with a
+//	bcopy instead of a lseek and a read or write system call each.
+//	Only the host side changes: requests still take the simulated
+//	time computed by ComputeLatency, and still complete with an
+//	interrupt.  The file is written back by Sync.
+//
+//	Return FALSE, and keep using read and write, if the host refuses
+//	the mapping.
+//----------------------------------------------------------------------
+
+bool
+Disk::UseMapping()
+{
+    ASSERT(!active);
+    if (image == NULL)
+	image = MapFile(fileno, DiskSize);
+    DEBUG('d', "Disk image %s\n", image != NULL ? "mapped" : "not mapped");
+    return image != NULL;
+}
+
+//----------------------------------------------------------------------
+// Disk::Sync
+// 	Wait until the writes done through the mapping are in the UNIX
+//	file.  Nothing to do without a mapping: writes go to the file
+//	right away.
+//----------------------------------------------------------------------
+
+void
+Disk::Sync()
+{
+    if (image != NULL)
+	SyncMappedFile(image, DiskSize);
+}
+
+//----------------------------------------------------------------------
+// Disk::HostRead/HostWrite
+// 	Copy "count" sectors, starting at "sectorNumber", from the UNIX
+//	file into "data" (from "data" into the UNIX file), through the
+//	mapping if there is one.
+//----------------------------------------------------------------------
+
+void
+Disk::HostRead(int sectorNumber, int count, char *data)
+{
+    if (image != NULL) {
+	bcopy(&image[SectorSize * sectorNumber + MagicSize], data,
+	      count * SectorSize);
+	return;
+    }
+    Lseek(fileno, SectorSize * sectorNumber + MagicSize, 0);
+    Read(fileno, data, count * SectorSize);
+}
+
+void
+Disk::HostWrite(int sectorNumber, int count, char *data)
+{
+    if (image != NULL) {
+	bcopy(data, &image[SectorSize * sectorNumber + MagicSize],
+	      count * SectorSize);
+	return;
+    }
+    Lseek(fileno, SectorSize * sectorNumber + MagicSize, 0);
+    WriteFile(fileno, data, count * SectorSize);
+}
+#endif
+
 //----------------------------------------------------------------------
 // Disk::PrintSector()
 // 	Dump the data in a disk read/write request, for debugging.
@@ -116,13 +194,22 @@ void
 Disk::ReadRequest(int sectorNumber, char* data)
 {
     int ticks = ComputeLatency(sectorNumber, FALSE);
+#ifdef CHANGED
+    int rotation;
+
+    stats->numSeekTicks += TimeToSeek(sectorNumber, &rotation);
+#endif
 
     ASSERT(!active);				// only one request at a time
     ASSERT((sectorNumber >= 0) && (sectorNumber < NumSectors));
     
     DEBUG('d', "Reading from sector %d\n", sectorNumber);
+#ifdef CHANGED
+    HostRead(sectorNumber, 1, data);
+#else
     Lseek(fileno, SectorSize * sectorNumber + MagicSize, 0);
     Read(fileno, data, SectorSize);
+#endif
     if (DebugIsEnabled('d'))
 	PrintSector(FALSE, sectorNumber, data);
     
@@ -136,13 +223,22 @@ void
 Disk::WriteRequest(int sectorNumber, char* data)
 {
     int ticks = ComputeLatency(sectorNumber, TRUE);
+#ifdef CHANGED
+    int rotation;
+
+    stats->numSeekTicks += TimeToSeek(sectorNumber, &rotation);
+#endif
 
     ASSERT(!active);
     ASSERT((sectorNumber >= 0) && (sectorNumber < NumSectors));
     
     DEBUG('d', "Writing to sector %d\n", sectorNumber);
+#ifdef CHANGED
+    HostWrite(sectorNumber, 1, data);
+#else
     Lseek(fileno, SectorSize * sectorNumber + MagicSize, 0);
     WriteFile(fileno, data, SectorSize);
+#endif
     if (DebugIsEnabled('d'))
 	PrintSector(TRUE, sectorNumber, data);
     
@@ -152,6 +248,74 @@ Disk::WriteRequest(int sectorNumber, char* data)
     interrupt->Schedule(DiskDone, (int) this, ticks, DiskInt);
 }
 
+#ifdef CHANGED
+//----------------------------------------------------------------------
+// Disk::ReadMultiple/WriteMultiple
+// 	Read/write "count" consecutive sectors, starting at "sectorNumber",
+//	in a single request: one interrupt when all of them are done.
+//	Sector i of the run goes to (comes from) buffers[i]; the buffers
+//	that follow each other in memory are transferred with a single
+//	host read (write).
+//
+//	The latency is that of the first sector, then one rotation time per
+//	further sector, plus a one track seek each time the run goes on
+//	to the next track.
+//----------------------------------------------------------------------
+
+void
+Disk::ReadMultiple(int sectorNumber, int count, char **buffers)
+{
+    MultipleRequest(sectorNumber, count, buffers, FALSE);
+}
+
+void
+Disk::WriteMultiple(int sectorNumber, int count, char **buffers)
+{
+    MultipleRequest(sectorNumber, count, buffers, TRUE);
+}
+
+void
+Disk::MultipleRequest(int sectorNumber, int count, char **buffers,
+		      bool writing)
+{
+    int lastNumber = sectorNumber + count - 1;
+    int trackSeeks = (lastNumber / SectorsPerTrack)
+		     - (sectorNumber / SectorsPerTrack);
+    int ticks = ComputeLatency(sectorNumber, writing)
+		+ (count - 1) * RotationTime + trackSeeks * SeekTime;
+    int rotation, i, j;
+
+    ASSERT(!active);
+    ASSERT((sectorNumber >= 0) && (count > 0) && (lastNumber < NumSectors));
+    stats->numSeekTicks += TimeToSeek(sectorNumber, &rotation)
+			   + trackSeeks * SeekTime;
+
+    DEBUG('d', "%s sectors %d to %d\n", writing ? "Writing" : "Reading",
+	  sectorNumber, lastNumber);
+    for (i = 0; i < count; i = j) {
+	for (j = i + 1; j < count && buffers[j] == buffers[j - 1] + SectorSize;
+	     j++)
+	    ;
+	if (writing)
+	    HostWrite(sectorNumber + i, j - i, buffers[i]);
+	else
+	    HostRead(sectorNumber + i, j - i, buffers[i]);
+    }
+    if (DebugIsEnabled('d'))
+	for (i = 0; i < count; i++)
+	    PrintSector(writing, sectorNumber + i, buffers[i]);
+
+    active = TRUE;
+    UpdateLast(sectorNumber);
+    UpdateLast(lastNumber);
+    if (writing)
+	stats->numDiskWrites++;
+    else
+	stats->numDiskReads++;
+    interrupt->Schedule(DiskDone, (int) this, ticks, DiskInt);
+}
+#endif
+
 //----------------------------------------------------------------------
 // Disk::HandleInterrupt()
 // 	Called when it is time to invoke the disk interrupt handler,
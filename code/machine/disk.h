@@ -66,6 +66,25 @@ class Disk {
     					// the disk and return immediately.
     					// Only one request allowed at a time!
     void WriteRequest(int sectorNumber, char* data);
+#ifdef CHANGED
+    void ReadMultiple(int sectorNumber, int count, char **buffers);
+    void WriteMultiple(int sectorNumber, int count, char **buffers);
+					// Same for "count" consecutive
+					// sectors, from "sectorNumber" on,
+					// to or from buffers[0..count-1]
+					// (scatter/gather).  The head seeks
+					// once, then transfers the sectors
+					// one after the other.
+
+    bool UseMapping();			// Access the UNIX file through a
+					// memory mapping instead of read
+					// and write calls.  The latency of
+					// requests is the same.  Return
+					// FALSE if the host cannot map it
+    void Sync();			// Make sure the UNIX file holds
+					// what was written through the
+					// mapping (also done on deletion)
+#endif
 
     void HandleInterrupt();		// Interrupt handler, invoked when
 					// disk request finishes.
@@ -88,6 +107,15 @@ class Disk {
     int TimeToSeek(int newSector, int *rotate); // time to get to the new track
     int ModuloDiff(int to, int from);        // # sectors between to and from
     void UpdateLast(int newSector);
+#ifdef CHANGED
+    void MultipleRequest(int sectorNumber, int count, char **buffers,
+			 bool writing);
+    char *image;			// the mapped UNIX file, or NULL
+    void HostRead(int sectorNumber, int count, char *data);
+    void HostWrite(int sectorNumber, int count, char *data);
+					// Move "count" sectors between
+					// "data" and the UNIX file
+#endif
 };
 
 #endif // DISK_H
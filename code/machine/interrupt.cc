@@ -181,6 +181,40 @@ Interrupt::OneTick()
     }
 }
 
+#ifdef CHANGED
+//----------------------------------------------------------------------
+// Interrupt::NextDueTime
+// 	Return the simulated time of the earliest pending interrupt, or
+//	-1 if nothing is pending.  The execution engines use it to know
+//	how many user instructions they may run before OneTick() has
+//	something to do besides advancing the clock.
+//----------------------------------------------------------------------
+
+long long
+Interrupt::NextDueTime()
+{
+    if (pending->IsEmpty())
+	return -1;
+    return ((PendingInterrupt *) pending->GetFirst())->when;
+}
+
+//----------------------------------------------------------------------
+// Interrupt::AdvanceUserTicks
+// 	Same effect as "count" calls to OneTick() in user mode, when the
+//	caller knows (from NextDueTime) that no interrupt becomes due
+//	before the last of them: only the clock moves.
+//----------------------------------------------------------------------
+
+void
+Interrupt::AdvanceUserTicks(int count)
+{
+    ASSERT(status == UserMode && !yieldOnReturn);
+    stats->totalTicks += count * UserTick;
+    stats->userTicks += count * UserTick;
+    ASSERT(pending->IsEmpty() || NextDueTime() > stats->totalTicks);
+}
+#endif
+
 //----------------------------------------------------------------------
 // Interrupt::YieldOnReturn
 // 	Called from within an interrupt handler, to cause a context switch
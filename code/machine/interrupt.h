@@ -112,6 +112,13 @@ class Interrupt {
     					// by the hardware device simulators.
     
     void OneTick();       		// Advance simulated time
+#ifdef CHANGED
+    long long NextDueTime();		// Time at which the next pending
+					// interrupt fires, -1 if none
+    void AdvanceUserTicks(int count);	// Account for "count" user
+					// instructions at once; no
+					// interrupt may be due meanwhile
+#endif
 
     bool IsBlockingQueueEmpty(); // check if there is any process blocking
   private:
@@ -0,0 +1,594 @@
+// jitsim.cc
+//	Dynamic translation of hot user basic blocks to host code,
+//	selected with "-engine jit".
+//
+//	The JIT engine is the threaded engine (threadedsim.cc) plus a
+//	profile: every time a block is entered its counter is bumped, and
+//	once it reaches JitThreshold the block is translated into native
+//	host code.  From then on, whenever the block is entered at its
+//	first instruction and no interrupt can become due before its last
+//	instruction, the native code runs the whole block in one call.
+//
+//	Nachos is built as a 32-bit host program (see HOST_TARGET_ARCH in
+//	Makefile.rules-nachos), so the code generator emits IA-32
+//	instructions.  On any other host, CompileBlock always fails and
+//	the engine behaves as the threaded one.
+//
+//	The generated code works directly on machine->registers, and
+//	reproduces the interpreter step by step: each instruction is
+//	followed by its delayed load, so the register file (including
+//	LoadReg and LoadValueReg) is exact between any two instructions.
+//	Memory accesses go through helper routines that translate the
+//	address; when an access would raise an exception, the native code
+//	returns early, and the faulting instruction is run again by its
+//	threaded handler, which raises the exception exactly as the
+//	interpreter does.  The program counters, which only depend on
+//	how far we went, and the clock are updated by RunCompiled after
+//	the native code returns.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifdef CHANGED
+
+#include "copyright.h"
+#include "machine.h"
+#include "mipssim.h"
+#include "threadedsim.h"
+#include "system.h"
+
+#define JitThreshold	50		// block entries before translation
+#define JitArenaSize	(1024 * 1024)	// bytes of generated code
+#define JitMaxOpSize	128		// upper bound of the code generated
+					// for a single MIPS instruction
+#define JitFrameSize	28		// stack space for helper arguments,
+					// keeps calls 16-byte aligned
+
+static char *jitArena = NULL;		// where the generated code lives
+static int jitUsed = 0;			// bytes of jitArena in use
+static bool jitUnavailable = FALSE;	// host refused executable memory
+
+static int jitTarget;			// branch target of the current block
+static int jitValue;			// value returned by JitLoad
+
+//----------------------------------------------------------------------
+// JitLoad, JitStore
+// 	Memory accesses for the generated code.  They behave as ReadMem
+//	and WriteMem, except that they never raise an exception: they
+//	return 0 instead, and the access is retried by the threaded
+//	handler.  Stores to a page holding predecoded code are also left
+//	to the handler, since invalidating that page could free the block
+//	being run.
+//----------------------------------------------------------------------
+
+static int
+JitLoad(int addr, int opCode)
+{
+    int physAddr, size;
+
+    switch (opCode) {
+      case OP_LW: size = 4; break;
+      case OP_LH: case OP_LHU: size = 2; break;
+      default: size = 1; break;
+    }
+    char *host = machine->SoftTranslate(addr, size, FALSE);
+    if (host == NULL) {
+	if (machine->Translate(addr, &physAddr, size, FALSE) != NoException)
+	    return 0;
+	host = &machine->mainMemory[physAddr];
+    }
+
+    switch (opCode) {
+      case OP_LW:
+	jitValue = WordToHost(*(unsigned int *) host);
+	break;
+      case OP_LH:
+	jitValue = (short) ShortToHost(*(unsigned short *) host);
+	break;
+      case OP_LHU:
+	jitValue = ShortToHost(*(unsigned short *) host);
+	break;
+      case OP_LB:
+	jitValue = (signed char) *host;
+	break;
+      default:
+	jitValue = (unsigned char) *host;
+	break;
+    }
+    return 1;
+}
+
+static int
+JitStore(int addr, int value, int size)
+{
+    int physAddr;
+
+    char *host = machine->SoftTranslate(addr, size, TRUE);
+    if (host == NULL) {
+	if (machine->Translate(addr, &physAddr, size, TRUE) != NoException)
+	    return 0;
+	if (machine->HasDecodedCode(physAddr / PageSize))
+	    return 0;
+	host = &machine->mainMemory[physAddr];
+    }
+
+    switch (size) {
+      case 1:
+	*host = (unsigned char) (value & 0xff);
+	break;
+      case 2:
+	*(unsigned short *) host
+		= ShortToMachine((unsigned short) (value & 0xffff));
+	break;
+      default:
+	*(unsigned int *) host = WordToMachine((unsigned int) value);
+	break;
+    }
+    return 1;
+}
+
+//----------------------------------------------------------------------
+// CodeBuffer
+// 	Minimal IA-32 assembler: every routine appends the encoding of
+//	one host instruction.  Memory operands are absolute addresses,
+//	which is fine on a 32-bit host.
+//----------------------------------------------------------------------
+
+class CodeBuffer {
+  public:
+    CodeBuffer(char *where) { start = next = (unsigned char *) where; }
+
+    int Size() { return next - start; }
+
+    void Byte(int b) { *next++ = (unsigned char) b; }
+    void Word(int w) { *(int *) next = w; next += 4; }
+    void Addr(int *p) { Word((int) p); }
+
+    // eax <- [p], [p] <- eax, and the same for ecx and edx
+    void LoadEAX(int *p) { Byte(0xa1); Addr(p); }
+    void StoreEAX(int *p) { Byte(0xa3); Addr(p); }
+    void LoadECX(int *p) { Byte(0x8b); Byte(0x0d); Addr(p); }
+    void StoreECX(int *p) { Byte(0x89); Byte(0x0d); Addr(p); }
+    void StoreEDX(int *p) { Byte(0x89); Byte(0x15); Addr(p); }
+    void StoreImm(int *p, int imm) { Byte(0xc7); Byte(0x05); Addr(p); Word(imm); }
+    void MovEAXImm(int imm) { Byte(0xb8); Word(imm); }
+
+    // eax <- eax op [p], with op one of add, or, and, sub, xor, cmp
+    void AluEAXMem(int opByte, int *p) { Byte(opByte); Byte(0x05); Addr(p); }
+    // eax <- eax op imm, same operations (short accumulator forms)
+    void AluEAXImm(int opByte, int imm) { Byte(opByte); Word(imm); }
+
+    void NotEAX() { Byte(0xf7); Byte(0xd0); }
+    void ShiftEAXImm(int ext, int count) { Byte(0xc1); Byte(0xc0 | (ext << 3)); Byte(count); }
+    void ShiftEAXCL(int ext) { Byte(0xd3); Byte(0xc0 | (ext << 3)); }
+    void SetccMovzx(int cc) {			// eax <- condition cc ? 1 : 0
+	Byte(0x0f); Byte(0x90 | cc); Byte(0xc0);
+	Byte(0x0f); Byte(0xb6); Byte(0xc0);
+    }
+    void MulMem(int ext, int *p) { Byte(0xf7); Byte((ext << 3) | 0x05); Addr(p); }
+
+    // [esp + disp] <- eax, [esp + disp] <- imm
+    void ArgEAX(int disp) { Byte(0x89); Byte(0x44); Byte(0x24); Byte(disp); }
+    void ArgImm(int disp, int imm) { Byte(0xc7); Byte(0x44); Byte(0x24); Byte(disp); Word(imm); }
+    void Call(void *fn) { MovEAXImm((int) fn); Byte(0xff); Byte(0xd0); }
+
+    void Prologue() { Byte(0x83); Byte(0xec); Byte(JitFrameSize); }
+    void Return(int count) {			// return count in eax
+	MovEAXImm(count);
+	Byte(0x83); Byte(0xc4); Byte(JitFrameSize);
+	Byte(0xc3);
+    }
+    void ReturnIfEAXZero(int count) {		// test eax,eax; jnz over
+	Byte(0x85); Byte(0xc0);
+	Byte(0x75); Byte(9);
+	Return(count);
+    }
+
+  private:
+    unsigned char *start;			// first byte of the code
+    unsigned char *next;			// where the next byte goes
+};
+
+// opcode bytes and condition codes used above
+#define X86_ADD		0x03
+#define X86_OR		0x0b
+#define X86_AND		0x23
+#define X86_SUB		0x2b
+#define X86_XOR		0x33
+#define X86_CMP		0x3b
+#define X86_ADD_IMM	0x05
+#define X86_OR_IMM	0x0d
+#define X86_AND_IMM	0x25
+#define X86_XOR_IMM	0x35
+#define X86_CMP_IMM	0x3d
+#define X86_SHL		4
+#define X86_SHR		5
+#define X86_SAR		7
+#define X86_MUL		4
+#define X86_IMUL	5
+#define CC_B		0x2
+#define CC_E		0x4
+#define CC_NE		0x5
+#define CC_L		0xc
+#define CC_GE		0xd
+#define CC_LE		0xe
+#define CC_G		0xf
+
+//----------------------------------------------------------------------
+// IsLoad, IsBranch
+// 	Classify the opcodes the code generator knows about.
+//----------------------------------------------------------------------
+
+static bool
+IsLoad(int opCode)
+{
+    return opCode == OP_LW || opCode == OP_LB || opCode == OP_LBU
+	|| opCode == OP_LH || opCode == OP_LHU;
+}
+
+static bool
+IsBranch(int opCode)
+{
+    switch (opCode) {
+      case OP_BEQ: case OP_BNE: case OP_BLEZ: case OP_BGTZ:
+      case OP_BLTZ: case OP_BGEZ: case OP_J: case OP_JAL:
+      case OP_JR: case OP_JALR:
+	return TRUE;
+      default:
+	return FALSE;
+    }
+}
+
+//----------------------------------------------------------------------
+// EmitOp
+// 	Generate the host code for the "index"th instruction of a block,
+//	without its delayed load.  "r" is the simulated register file.
+//	Return FALSE if the instruction is not supported by the code
+//	generator.
+//----------------------------------------------------------------------
+
+static bool
+EmitOp(CodeBuffer *code, int *r, Instruction *instr, int index)
+{
+    int rd = instr->rd, rs = instr->rs, rt = instr->rt;
+    int imm = instr->extra;
+    int cc;
+
+    switch (instr->opCode) {
+      case OP_ADDU: case OP_SUBU: case OP_AND: case OP_OR:
+      case OP_XOR: case OP_NOR:
+	if (rd == 0)
+	    return TRUE;		// r0 is reset by the delayed load
+	code->LoadEAX(&r[rs]);
+	switch (instr->opCode) {
+	  case OP_ADDU: code->AluEAXMem(X86_ADD, &r[rt]); break;
+	  case OP_SUBU: code->AluEAXMem(X86_SUB, &r[rt]); break;
+	  case OP_AND: code->AluEAXMem(X86_AND, &r[rt]); break;
+	  case OP_XOR: code->AluEAXMem(X86_XOR, &r[rt]); break;
+	  default: code->AluEAXMem(X86_OR, &r[rt]); break;
+	}
+	if (instr->opCode == OP_NOR)
+	    code->NotEAX();
+	code->StoreEAX(&r[rd]);
+	return TRUE;
+
+      case OP_ADDIU: case OP_ANDI: case OP_ORI: case OP_XORI:
+	if (rt == 0)
+	    return TRUE;
+	code->LoadEAX(&r[rs]);
+	switch (instr->opCode) {
+	  case OP_ADDIU: code->AluEAXImm(X86_ADD_IMM, imm); break;
+	  case OP_ANDI: code->AluEAXImm(X86_AND_IMM, imm & 0xffff); break;
+	  case OP_ORI: code->AluEAXImm(X86_OR_IMM, imm & 0xffff); break;
+	  default: code->AluEAXImm(X86_XOR_IMM, imm & 0xffff); break;
+	}
+	code->StoreEAX(&r[rt]);
+	return TRUE;
+
+      case OP_LUI:
+	if (rt != 0)
+	    code->StoreImm(&r[rt], imm << 16);
+	return TRUE;
+
+      case OP_SLL: case OP_SRL: case OP_SRA:
+	if (rd == 0)
+	    return TRUE;
+	code->LoadEAX(&r[rt]);
+	code->ShiftEAXImm(instr->opCode == OP_SLL ? X86_SHL :
+			  instr->opCode == OP_SRL ? X86_SHR : X86_SAR, imm);
+	code->StoreEAX(&r[rd]);
+	return TRUE;
+
+      case OP_SLLV: case OP_SRLV: case OP_SRAV:
+	if (rd == 0)
+	    return TRUE;
+	code->LoadECX(&r[rs]);		// the host masks the count to 5 bits
+	code->LoadEAX(&r[rt]);
+	code->ShiftEAXCL(instr->opCode == OP_SLLV ? X86_SHL :
+			 instr->opCode == OP_SRLV ? X86_SHR : X86_SAR);
+	code->StoreEAX(&r[rd]);
+	return TRUE;
+
+      case OP_SLT: case OP_SLTU:
+	if (rd == 0)
+	    return TRUE;
+	code->LoadEAX(&r[rs]);
+	code->AluEAXMem(X86_CMP, &r[rt]);
+	code->SetccMovzx(instr->opCode == OP_SLT ? CC_L : CC_B);
+	code->StoreEAX(&r[rd]);
+	return TRUE;
+
+      case OP_SLTI: case OP_SLTIU:
+	if (rt == 0)
+	    return TRUE;
+	code->LoadEAX(&r[rs]);
+	code->AluEAXImm(X86_CMP_IMM, imm);
+	code->SetccMovzx(instr->opCode == OP_SLTI ? CC_L : CC_B);
+	code->StoreEAX(&r[rt]);
+	return TRUE;
+
+      case OP_MFHI: case OP_MFLO:
+	if (rd == 0)
+	    return TRUE;
+	code->LoadEAX(&r[instr->opCode == OP_MFHI ? HiReg : LoReg]);
+	code->StoreEAX(&r[rd]);
+	return TRUE;
+
+      case OP_MTHI: case OP_MTLO:
+	code->LoadEAX(&r[rs]);
+	code->StoreEAX(&r[instr->opCode == OP_MTHI ? HiReg : LoReg]);
+	return TRUE;
+
+      case OP_MULT: case OP_MULTU:
+	// edx:eax is the exact 64-bit product, as computed by Mult()
+	code->LoadEAX(&r[rs]);
+	code->MulMem(instr->opCode == OP_MULT ? X86_IMUL : X86_MUL, &r[rt]);
+	code->StoreEAX(&r[LoReg]);
+	code->StoreEDX(&r[HiReg]);
+	return TRUE;
+
+      case OP_LW: case OP_LB: case OP_LBU: case OP_LH: case OP_LHU:
+	code->LoadEAX(&r[rs]);
+	code->AluEAXImm(X86_ADD_IMM, imm);
+	code->ArgEAX(0);
+	code->ArgImm(4, instr->opCode);
+	code->Call((void *) JitLoad);
+	code->ReturnIfEAXZero(index);
+	return TRUE;
+
+      case OP_SW: case OP_SB: case OP_SH:
+	code->LoadEAX(&r[rs]);
+	code->AluEAXImm(X86_ADD_IMM, imm);
+	code->ArgEAX(0);
+	code->LoadEAX(&r[rt]);
+	code->ArgEAX(4);
+	code->ArgImm(8, instr->opCode == OP_SW ? 4 :
+			instr->opCode == OP_SH ? 2 : 1);
+	code->Call((void *) JitStore);
+	code->ReturnIfEAXZero(index);
+	return TRUE;
+
+      case OP_J: case OP_JAL:
+	// NextPC + 4 = entry PC + 4 * (index + 2)
+	code->LoadEAX(&r[PCReg]);
+	code->AluEAXImm(X86_ADD_IMM, 4 * (index + 2));
+	if (instr->opCode == OP_JAL)
+	    code->StoreEAX(&r[R31]);
+	code->AluEAXImm(X86_AND_IMM, 0xf0000000);
+	code->AluEAXImm(X86_OR_IMM, IndexToAddr(imm));
+	code->StoreEAX(&jitTarget);
+	return TRUE;
+
+      case OP_JR: case OP_JALR:
+	if (instr->opCode == OP_JALR) {
+	    if (rd == 0)
+		return FALSE;		// would need r0 to be reset
+	    code->LoadEAX(&r[PCReg]);
+	    code->AluEAXImm(X86_ADD_IMM, 4 * (index + 2));
+	    code->StoreEAX(&r[rd]);
+	}
+	code->LoadEAX(&r[rs]);		// after rd, as in the interpreter
+	code->StoreEAX(&jitTarget);
+	return TRUE;
+
+      case OP_BEQ: case OP_BNE: case OP_BLEZ: case OP_BGTZ:
+      case OP_BLTZ: case OP_BGEZ:
+	// jitTarget <- taken ? NextPC + offset : NextPC + 4
+	code->LoadEAX(&r[PCReg]);
+	code->AluEAXImm(X86_ADD_IMM, 4 * (index + 2));
+	code->StoreEAX(&jitTarget);
+	code->LoadEAX(&r[rs]);
+	if (instr->opCode == OP_BEQ || instr->opCode == OP_BNE)
+	    code->AluEAXMem(X86_CMP, &r[rt]);
+	else
+	    code->AluEAXImm(X86_CMP_IMM, 0);
+	switch (instr->opCode) {
+	  case OP_BEQ: cc = CC_NE; break;	// conditions for NOT taken
+	  case OP_BNE: cc = CC_E; break;
+	  case OP_BLEZ: cc = CC_G; break;
+	  case OP_BGTZ: cc = CC_LE; break;
+	  case OP_BLTZ: cc = CC_GE; break;
+	  default: cc = CC_L; break;
+	}
+	// jcc over the update of jitTarget (5 + 5 + 5 bytes)
+	code->Byte(0x70 | cc);
+	code->Byte(15);
+	code->LoadEAX(&r[PCReg]);
+	code->AluEAXImm(X86_ADD_IMM, 4 * (index + 1) + IndexToAddr(imm));
+	code->StoreEAX(&jitTarget);
+	return TRUE;
+
+      default:
+	return FALSE;
+    }
+}
+
+//----------------------------------------------------------------------
+// EmitDelayedLoad
+// 	Generate the delayed load that ends instruction "instr" of a
+//	block.  "prev" is the previous instruction, NULL for the first
+//	one: we then do not know what load is pending, and emit the
+//	general case of DelayedLoad().  Otherwise the register being
+//	loaded, if any, is known.
+//----------------------------------------------------------------------
+
+static void
+EmitDelayedLoad(CodeBuffer *code, int *r, Instruction *prev,
+		Instruction *instr)
+{
+
+    if (prev == NULL) {
+	// registers[registers[LoadReg]] = registers[LoadValueReg]
+	code->LoadECX(&r[LoadReg]);
+	code->LoadEAX(&r[LoadValueReg]);
+	code->Byte(0x89); code->Byte(0x04); code->Byte(0x8d);
+	code->Addr(r);
+	code->StoreImm(&r[0], 0);
+    } else if (IsLoad(prev->opCode) && prev->rt != 0) {
+	code->LoadEAX(&r[LoadValueReg]);
+	code->StoreEAX(&r[prev->rt]);
+    }
+
+    if (IsLoad(instr->opCode)) {
+	code->LoadEAX(&jitValue);
+	code->StoreEAX(&r[LoadValueReg]);
+	code->StoreImm(&r[LoadReg], instr->rt);
+    } else if (prev == NULL || IsLoad(prev->opCode)) {
+	code->StoreImm(&r[LoadReg], 0);
+	code->StoreImm(&r[LoadValueReg], 0);
+    }
+}
+
+//----------------------------------------------------------------------
+// Machine::CompileBlock
+// 	Translate "block" to host code.  Only blocks made of supported
+//	instructions, and ending either at the end of the page or with a
+//	branch followed by its delay slot, are translated.
+//	Returns FALSE if the block cannot be translated.
+//----------------------------------------------------------------------
+
+bool
+Machine::CompileBlock(ThreadedBlock *block)
+{
+#ifdef HOST_i386
+    int i, last = block->numOps - 1;
+
+    if (jitUnavailable)
+	return FALSE;
+    for (i = 0; i < last; i++)
+	if (IsBranch(block->ops[i].instr.opCode) && i != last - 1)
+	    return FALSE;
+    if (IsBranch(block->ops[last].instr.opCode))
+	return FALSE;			// delay slot in the next page,
+					// or branch in a delay slot
+
+    if (jitArena == NULL) {
+	jitArena = AllocExecutable(JitArenaSize);
+	if (jitArena == NULL) {
+	    jitUnavailable = TRUE;
+	    return FALSE;
+	}
+    }
+    if (jitUsed + (block->numOps + 1) * JitMaxOpSize > JitArenaSize)
+	FlushCompiledCode();
+
+    CodeBuffer code(jitArena + jitUsed);
+    code.Prologue();
+    for (i = 0; i <= last; i++) {
+	if (!EmitOp(&code, registers, &block->ops[i].instr, i))
+	    return FALSE;		// nothing is committed yet
+	EmitDelayedLoad(&code, registers,
+			(i == 0) ? NULL : &block->ops[i - 1].instr,
+			&block->ops[i].instr);
+    }
+    code.Return(block->numOps);
+
+    block->native = (JitFunction) (jitArena + jitUsed);
+    block->branchIndex = (block->numOps >= 2 &&
+			  IsBranch(block->ops[last - 1].instr.opCode))
+			 ? last - 1 : -1;
+    jitUsed += code.Size();
+    DEBUG('m', "Compiled block at 0x%x, %d instructions, %d bytes\n",
+	  block->physStart, block->numOps, code.Size());
+    return TRUE;
+#else
+    return FALSE;
+#endif
+}
+
+//----------------------------------------------------------------------
+// Machine::FlushCompiledCode
+// 	Forget every translation, to reuse the code area when it is full.
+//	Blocks stay around and may be compiled again once hot.
+//----------------------------------------------------------------------
+
+void
+Machine::FlushCompiledCode()
+{
+    for (int i = 0; i < MemorySize / 4; i++)
+	if (blockAt[i] != NULL) {
+	    blockAt[i]->native = NULL;
+	    blockAt[i]->entryCount = 0;
+	}
+    jitUsed = 0;
+}
+
+//----------------------------------------------------------------------
+// Machine::RunCompiled
+// 	Called by RunThreaded each time "block" is entered, with the PC
+//	on its first instruction.  Profile the block, translate it when it
+//	gets hot, and run its translation if it is safe to do so: we must
+//	not be in a delay slot, and the clock must not reach the next
+//	pending interrupt before the last instruction of the block, so
+//	that all but the last OneTick() would only have advanced time.
+//
+//	Returns FALSE if nothing was executed, TRUE if the native code ran
+//	one or more instructions, the machine state being then exactly
+//	the one the interpreter would have reached.
+//----------------------------------------------------------------------
+
+bool
+Machine::RunCompiled(ThreadedBlock *block)
+{
+    if (block->native == NULL) {
+	if (block->entryCount < 0 || ++block->entryCount < JitThreshold)
+	    return FALSE;
+	if (!CompileBlock(block)) {
+	    block->entryCount = -1;	// do not try again
+	    return FALSE;
+	}
+    }
+
+    int pc = registers[PCReg];
+
+    if (registers[NextPCReg] != pc + 4 || DebugIsEnabled('i'))
+	return FALSE;
+    FlushDeferredTicks();		// the clock must be exact below
+    long long due = interrupt->NextDueTime();
+    if (due >= 0 && stats->totalTicks + (block->numOps - 1) * UserTick >= due)
+	return FALSE;
+
+    int done = (*block->native)();
+    if (done == 0)
+	return FALSE;			// first instruction must trap
+
+    int last = pc + 4 * (done - 1);	// last instruction executed
+    registers[PrevPCReg] = last;
+    if (block->branchIndex >= 0 && done - 1 == block->branchIndex) {
+	registers[PCReg] = last + 4;	// stopped in the delay slot
+	registers[NextPCReg] = jitTarget;
+    } else if (block->branchIndex >= 0 && done - 1 > block->branchIndex) {
+	registers[PCReg] = jitTarget;
+	registers[NextPCReg] = jitTarget + 4;
+    } else {
+	registers[PCReg] = last + 4;
+	registers[NextPCReg] = last + 8;
+    }
+
+    interrupt->AdvanceUserTicks(done - 1);
+    TickNow();				// may fire interrupts, or switch
+    return TRUE;
+}
+
+#endif // CHANGED
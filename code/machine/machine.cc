@@ -81,6 +81,29 @@ Machine::Machine(bool debug)
     //For Join Functionality
     activeProcess = new ListForJoin();
     activeProcessLocks = new ListForJoin();
+
+    decodedInstrs = new Instruction[MemorySize / 4];
+    decodedValid = new bool[MemorySize / 4];
+    for (i = 0; i < MemorySize / 4; i++)
+	decodedValid[i] = FALSE;
+    for (i = 0; i < NumPhysPages; i++)
+	decodedPage[i] = FALSE;
+
+    engine = InterpreterEngine;
+    mappingEpoch = 0;
+    blockAt = new ThreadedBlock *[MemorySize / 4];
+    for (i = 0; i < MemorySize / 4; i++)
+	blockAt[i] = NULL;
+
+    batchTicks = FALSE;
+    ticksLeft = 0;
+    deferredTicks = 0;
+    FlushSoftMMU();
+
+    tlbSets = 1;		// USE_TLB: one fully associative set
+    tlbWays = TLBSize;
+    tlbVictim = new int[1];
+    tlbVictim[0] = 0;
 #endif
 
     singleStep = debug;
@@ -102,6 +125,12 @@ Machine::~Machine()
     delete PIDseedLock;
     delete activeProcess;
     delete activeProcessLocks;
+    delete [] decodedInstrs;
+    delete [] decodedValid;
+    for (int i = 0; i < NumPhysPages; i++)
+	FreeBlocks(i);
+    delete [] blockAt;
+    delete [] tlbVictim;
 #endif
 }
 
@@ -123,7 +152,14 @@ Machine::RaiseException(ExceptionType which, int badVAddr)
 //  ASSERT(interrupt->getStatus() == UserMode);
     registers[BadVAddrReg] = badVAddr;
     DelayedLoad(0, 0);			// finish anything in progress
+#ifdef CHANGED
+    FlushDeferredTicks();		// the kernel must see the exact time
+    ticksLeft = 0;			// and tick for real once back
+#endif
     interrupt->setStatus(SystemMode);
+#ifdef CHANGED
+    MappingChanged();			// the kernel may change anything
+#endif
     ExceptionHandler(which);		// interrupts are enabled at this point
     interrupt->setStatus(UserMode);
 }
@@ -27,6 +27,8 @@
 #include "disk.h"
 #ifdef CHANGED
 #include "synch.h"
+
+class ThreadedBlock;
 #endif
 
 // Definitions related to the size, and format of user memory
@@ -38,6 +40,10 @@
 #define NumPhysPages    256
 #define MemorySize 	(NumPhysPages * PageSize)
 #define TLBSize		4		// if there is a TLB, make it small
+#ifdef CHANGED
+#define SoftMMUSize	64		// entries in the translation cache
+					// of the load/store fast path
+#endif
 
 enum ExceptionType { NoException,           // Everything ok!
 		     SyscallException,      // A program executed a system call.
@@ -94,6 +100,21 @@ class Instruction {
                      // Immediates are sign-extended.
 };
 
+#ifdef CHANGED
+// One entry of the software MMU: the last translation of a virtual page
+// whose number is congruent to the entry index, modulo SoftMMUSize.
+// A tag is the virtual page number for which the access is known to
+// be allowed, or -1.
+
+class SoftMMUEntry {
+  public:
+    int readTag;		// vpn that may be read through "host"
+    int writeTag;		// vpn that may be written through "host"
+    int frame;			// physical page of that vpn
+    char *host;			// &mainMemory[frame * PageSize]
+};
+#endif
+
 // The following class defines the simulated host workstation hardware, as 
 // seen by user programs -- the CPU registers, main memory, etc.
 // User programs shouldn't be able to tell that they are running on our 
@@ -128,6 +149,20 @@ class Machine {
     				// Run one instruction of a user program.
     void DelayedLoad(int nextReg, int nextVal);  	
 				// Do a pending delayed load (modifying a reg)
+#ifdef CHANGED
+    bool FetchDecoded(Instruction *instr);
+				// Fetch the instruction at PC through the
+				// predecoded instruction cache.  Return
+				// FALSE if an exception occurred.
+    void ExecuteInstruction(Instruction *instr);
+				// Execute an already decoded instruction
+    void RunThreaded();		// Run a user program with the threaded
+				// code engine (threadedsim.cc)
+    bool RunCompiled(ThreadedBlock *block);
+				// Run "block" as host code if it is hot
+				// enough and safe to (jitsim.cc)
+    bool HasDecodedCode(int frame) { return decodedPage[frame]; }
+#endif
     
     bool ReadMem(int addr, int size, int* value);
     bool WriteMem(int addr, int size, int value);
@@ -154,6 +189,55 @@ class Machine {
     int DecrementProcesses();
     
     int GetPIDSeed();
+
+    void InvalidateDecodedPage(int frame);
+				// Forget the predecoded instructions of
+				// physical page "frame", because its
+				// contents have changed or it has been
+				// handed to another address space
+
+    enum Engine { InterpreterEngine, ThreadedEngine, JitEngine };
+    void SetEngine(Engine which) { engine = which; }
+				// Select how Run() executes user code
+
+    void MappingChanged() { mappingEpoch++; FlushSoftMMU(); }
+				// The virtual to physical mapping of the
+				// running program may have changed: stop
+				// chaining through cached code, and
+				// forget the cached translations.  Must
+				// be called after any edit of the page
+				// table or of the TLB, including clearing
+				// a use or dirty bit
+
+    void EnableTLB(int size, int ways);
+				// Translate user addresses through a
+				// TLB of "size" entries, in sets of
+				// "ways" entries
+    void LoadTLB(TranslationEntry *entry);
+				// Copy "entry" into the TLB, replacing
+				// an entry of its set if needed
+    void FlushTLB();		// Write the use and dirty bits of the
+				// TLB back to the page table, and empty it
+
+    char *SoftTranslate(int virtAddr, int size, bool writing)
+	{ unsigned int vpn = (unsigned) virtAddr / PageSize;
+	  SoftMMUEntry *e = &softMMU[vpn % SoftMMUSize];
+	  if ((virtAddr & (size - 1)) != 0 ||
+	      (writing ? e->writeTag : e->readTag) != (int) vpn)
+	      return NULL;
+	  return e->host + (unsigned) virtAddr % PageSize; }
+				// Fast path of ReadMem and WriteMem: the
+				// host address of "virtAddr", if its
+				// translation is cached, NULL otherwise
+				// (then call Translate)
+
+    void SetBatchTicks(bool on) { batchTicks = on; }
+				// Account for the clock in bulk, instead
+				// of calling OneTick() after each
+				// instruction
+    void InstructionDone()	// Account for one user instruction
+	{ if (--ticksLeft > 0) deferredTicks++; else TickNow(); }
+    void FlushDeferredTicks();	// Add the deferred ticks to the clock
 #endif
 
 
@@ -211,6 +295,39 @@ class Machine {
 #ifdef CHANGED     
     int PIDseed;
     Lock *PIDseedLock;
+
+    Instruction *decodedInstrs;	// predecoded copy of every word of
+				// mainMemory, indexed by physAddr / 4
+    bool *decodedValid;		// is decodedInstrs[i] up to date?
+    bool decodedPage[NumPhysPages];
+				// does this frame hold any valid
+				// decodedInstrs entry?
+
+    Engine engine;		// execution engine used by Run()
+    unsigned int mappingEpoch;	// bumped by MappingChanged()
+    ThreadedBlock **blockAt;	// threaded block starting at each
+				// physical word, or NULL
+    ThreadedBlock *BuildBlock(int physAddr);
+    void FreeBlocks(int frame);
+    bool CompileBlock(ThreadedBlock *block);
+    void FlushCompiledCode();
+
+    bool batchTicks;		// is bulk tick accounting enabled?
+    int ticksLeft;		// instructions to run before the next
+				// real OneTick()
+    int deferredTicks;		// user ticks executed, but not yet
+				// added to the clock
+    void TickNow();
+
+    int tlbSets;		// number of sets of the TLB
+    int tlbWays;		// entries per set
+    int *tlbVictim;		// next entry to replace in each set
+    void WriteBackTLBEntry(TranslationEntry *entry);
+
+    SoftMMUEntry softMMU[SoftMMUSize];
+    void FillSoftMMU(int vpn, int frame, bool writing);
+    void FlushSoftMMU();
+    void MarkDecoded(int frame);
 #endif // End CHANGED
 				// time reaches this value
 };
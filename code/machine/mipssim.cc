@@ -48,9 +48,21 @@ Machine::Run()
     // End of correction
 
     interrupt->setStatus(UserMode);
+#ifdef CHANGED
+    // the threaded engine neither single steps nor traces instructions,
+    // and skips the translation of most fetches, which would distort
+    // the TLB statistics
+    if (engine != InterpreterEngine && !singleStep && !DebugIsEnabled('m')
+	&& tlb == NULL)
+	RunThreaded();		// never returns
+#endif
     for (;;) {
         OneInstruction(instr);
+#ifdef CHANGED
+	InstructionDone();
+#else
 	interrupt->OneTick();
+#endif
 	if (singleStep && (runUntilTime <= stats->totalTicks))
 	  Debugger();
     }
@@ -105,6 +117,150 @@ TypeToReg(RegType reg, Instruction *instr)
 void
 Machine::OneInstruction(Instruction *instr)
 {
+#ifdef CHANGED
+    // Fetch instruction, already decoded if it was executed before
+    if (!FetchDecoded(instr))
+	return;			// exception occurred
+    ExecuteInstruction(instr);
+}
+
+//----------------------------------------------------------------------
+// Machine::FetchDecoded
+// 	Fetch the instruction at the current PC into "instr".
+//
+//	Decoding is done once per physical word: the decoded form is
+//	kept in decodedInstrs until the frame is written to (WriteMem)
+//	or handed out again (FrameProvider), at which point the whole
+//	page is invalidated.  The fetch still goes through Translate, so
+//	page faults and the use bit behave exactly as with ReadMem.
+//
+//	Returns FALSE if the translation failed; the exception has then
+//	already been raised.
+//----------------------------------------------------------------------
+
+bool
+Machine::FetchDecoded(Instruction *instr)
+{
+    int physAddr;
+    ExceptionType exception;
+
+    exception = Translate(registers[PCReg], &physAddr, 4, FALSE);
+    if (exception != NoException) {
+	RaiseException(exception, registers[PCReg]);
+	return FALSE;
+    }
+
+    int slot = physAddr / 4;
+    if (!decodedValid[slot]) {
+	decodedInstrs[slot].value =
+		WordToHost(*(unsigned int *) &mainMemory[physAddr]);
+	decodedInstrs[slot].Decode();
+	decodedValid[slot] = TRUE;
+	MarkDecoded(physAddr / PageSize);
+    }
+    *instr = decodedInstrs[slot];
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// Machine::MarkDecoded
+// 	Note that physical page "frame" now holds decoded instructions.
+//	From now on, writes to it must go through the slow path of
+//	WriteMem, so take back the write permissions of the software MMU.
+//----------------------------------------------------------------------
+
+void
+Machine::MarkDecoded(int frame)
+{
+    if (decodedPage[frame])
+	return;
+    decodedPage[frame] = TRUE;
+    for (int i = 0; i < SoftMMUSize; i++)
+	if (softMMU[i].writeTag != -1 && softMMU[i].frame == frame)
+	    softMMU[i].writeTag = -1;
+}
+
+//----------------------------------------------------------------------
+// Machine::InvalidateDecodedPage
+// 	Drop every predecoded instruction of physical page "frame".
+//	Must be called by anyone modifying mainMemory without going
+//	through WriteMem.
+//----------------------------------------------------------------------
+
+void
+Machine::InvalidateDecodedPage(int frame)
+{
+    ASSERT((frame >= 0) && (frame < NumPhysPages));
+    if (!decodedPage[frame])
+	return;
+    for (int i = 0; i < PageSize / 4; i++)
+	decodedValid[frame * (PageSize / 4) + i] = FALSE;
+    decodedPage[frame] = FALSE;
+    FreeBlocks(frame);		// the threaded code built from them too
+    MappingChanged();		// which may be the block now running
+}
+
+//----------------------------------------------------------------------
+// Machine::FlushDeferredTicks
+// 	Add to the clock the user instructions that InstructionDone()
+//	has counted without calling OneTick().  Nothing can be due
+//	before them (see TickNow), so this is all OneTick() would have
+//	done for each of them.
+//----------------------------------------------------------------------
+
+void
+Machine::FlushDeferredTicks()
+{
+    if (deferredTicks > 0) {
+	interrupt->AdvanceUserTicks(deferredTicks);
+	deferredTicks = 0;
+    }
+}
+
+//----------------------------------------------------------------------
+// Machine::TickNow
+// 	Called by InstructionDone() when the instruction just executed
+//	must go through a real OneTick().  Bring the clock up to date,
+//	tick, and compute how many instructions may run before the next
+//	one: with bulk accounting, all of them until the one whose tick
+//	reaches the earliest pending interrupt, bounded by
+//	MaxTickBatch so that the clock is never too far behind.
+//
+//	RaiseException flushes the deferred ticks and zeroes ticksLeft,
+//	since the kernel reads the clock and may schedule new interrupts.
+//----------------------------------------------------------------------
+
+#define MaxTickBatch	1000
+
+void
+Machine::TickNow()
+{
+    FlushDeferredTicks();
+    interrupt->OneTick();		// may fire interrupts, or switch
+    ticksLeft = 1;
+    if (batchTicks && !singleStep) {
+	long long due = interrupt->NextDueTime();
+
+	if (due < 0 || due - stats->totalTicks >= MaxTickBatch * UserTick)
+	    ticksLeft = MaxTickBatch;
+	else if (due - stats->totalTicks > UserTick)
+	    ticksLeft = (int) ((due - stats->totalTicks) / UserTick);
+    }
+}
+
+//----------------------------------------------------------------------
+// Machine::ExecuteInstruction
+// 	Execute the decoded instruction "instr", which must be the one
+//	at the current PC.  Same exception conventions as OneInstruction.
+//----------------------------------------------------------------------
+
+void
+Machine::ExecuteInstruction(Instruction *instr)
+{
+    int nextLoadReg = 0; 	
+    int nextLoadValue = 0; 	// record delayed load operation, to apply
+				// in the future
+#else
     int raw;
     int nextLoadReg = 0; 	
     int nextLoadValue = 0; 	// record delayed load operation, to apply
@@ -115,6 +271,7 @@ Machine::OneInstruction(Instruction *instr)
 	return;			// exception occurred
     instr->value = raw;
     instr->Decode();
+#endif
 
     if (DebugIsEnabled('m')) {
        struct OpString *str = &opStrings[instr->opCode];
@@ -22,6 +22,13 @@ Statistics::Statistics()
     numDiskReads = numDiskWrites = 0;
     numConsoleCharsRead = numConsoleCharsWritten = 0;
     numPageFaults = numPacketsSent = numPacketsRecvd = 0;
+#ifdef CHANGED
+    numTLBHits = numTLBMisses = numTLBRefills = 0;
+    numCopyOnWrites = 0;
+    numZeroedFrameHits = numZeroedFrameMisses = 0;
+    numBufferHits = numBufferMisses = numReadAheads = 0;
+    numSeekTicks = 0;
+#endif
 }
 
 //----------------------------------------------------------------------
@@ -41,9 +48,26 @@ Statistics::Print()
   // End of correction
 
     printf("Disk I/O: reads %d, writes %d\n", numDiskReads, numDiskWrites);
+#ifdef CHANGED
+    if (numSeekTicks > 0)
+	printf("Disk seeks: %lld ticks\n", numSeekTicks);
+    if (numBufferHits + numBufferMisses > 0)
+	printf("Buffer cache: hits %d, misses %d, read-aheads %d\n",
+	    numBufferHits, numBufferMisses, numReadAheads);
+#endif
     printf("Console I/O: reads %d, writes %d\n", numConsoleCharsRead, 
 	numConsoleCharsWritten);
     printf("Paging: faults %d\n", numPageFaults);
+#ifdef CHANGED
+    if (numTLBHits + numTLBMisses > 0)
+	printf("TLB: hits %d, misses %d, refills %d\n", numTLBHits,
+	    numTLBMisses, numTLBRefills);
+    if (numCopyOnWrites > 0)
+	printf("Copy-on-write: pages copied %d\n", numCopyOnWrites);
+    if (numZeroedFrameHits + numZeroedFrameMisses > 0)
+	printf("Frames: zeroed pool hits %d, misses %d\n",
+	    numZeroedFrameHits, numZeroedFrameMisses);
+#endif
     printf("Network I/O: packets received %d, sent %d\n", numPacketsRecvd, 
 	numPacketsSent);
 }
@@ -45,6 +45,20 @@ class Statistics {
     int numPageFaults;		// number of virtual memory page faults
     int numPacketsSent;		// number of packets sent over the network
     int numPacketsRecvd;	// number of packets received over the network
+#ifdef CHANGED
+    int numTLBHits;		// user translations found in the TLB
+    int numTLBMisses;		// user translations missing from the TLB
+    int numTLBRefills;		// TLB entries loaded by the kernel
+    int numCopyOnWrites;	// shared pages copied on a write
+    int numZeroedFrameHits;	// frames allocated already zeroed
+    int numZeroedFrameMisses;	// frames that had to be zeroed on
+				// allocation
+    int numBufferHits;		// sectors found in the buffer cache
+    int numBufferMisses;	// sectors that had to be read (or
+				// allocated) in the buffer cache
+    int numReadAheads;		// sectors prefetched by read-ahead
+    long long numSeekTicks;	// time the disk spent seeking
+#endif
 
     Statistics(); 		// initialize everything to zero
 
@@ -502,3 +502,65 @@ DeallocBoundedArray(char *ptr, int size)
     mprotect(ptr + size, pgSize, PROT_READ | PROT_WRITE | PROT_EXEC);
     delete [] (ptr - pgSize);
 }
+
+#ifdef CHANGED
+//----------------------------------------------------------------------
+// AllocExecutable
+// 	Return an area of "size" bytes that can be written to and then
+//	executed, for the code generated by the JIT engine (jitsim.cc).
+//	The area is never released.  Returns NULL on failure.
+//----------------------------------------------------------------------
+
+char *
+AllocExecutable(int size)
+{
+    void *ptr = mmap(NULL, size, PROT_READ | PROT_WRITE | PROT_EXEC,
+		     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if (ptr == MAP_FAILED)
+	return NULL;
+    return (char *) ptr;
+}
+
+//----------------------------------------------------------------------
+// MapFile
+// 	Map the first "size" bytes of the open file "fd" into memory,
+//	readable and writable, and shared with the file: stores into the
+//	area modify the file.  Returns NULL on failure.
+//----------------------------------------------------------------------
+
+char *
+MapFile(int fd, int size)
+{
+    void *ptr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+    if (ptr == MAP_FAILED)
+	return NULL;
+    return (char *) ptr;
+}
+
+//----------------------------------------------------------------------
+// SyncMappedFile
+// 	Write the modified pages of an area returned by MapFile back to
+//	the file, and wait until they are written.
+//----------------------------------------------------------------------
+
+void
+SyncMappedFile(char *addr, int size)
+{
+    int retVal = msync(addr, size, MS_SYNC);
+    ASSERT(retVal == 0);
+}
+
+//----------------------------------------------------------------------
+// UnmapFile
+// 	Remove the mapping of an area returned by MapFile.
+//----------------------------------------------------------------------
+
+void
+UnmapFile(char *addr, int size)
+{
+    int retVal = munmap(addr, size);
+    ASSERT(retVal == 0);
+}
+#endif
@@ -55,6 +55,19 @@ extern int Random();
 extern char *AllocBoundedArray(int size);
 extern void DeallocBoundedArray(char *p, int size);
 
+#ifdef CHANGED
+// Allocate memory the host is allowed to execute, for generated code.
+// Returns NULL if the host refuses.
+extern char *AllocExecutable(int size);
+
+// Map "size" bytes of open file "fd" into memory, shared with the file.
+// Returns NULL if the host refuses.  SyncMappedFile writes the modified
+// pages back to the file, and returns once they are there.
+extern char *MapFile(int fd, int size);
+extern void SyncMappedFile(char *addr, int size);
+extern void UnmapFile(char *addr, int size);
+#endif
+
 // Other C library routines that are used by Nachos.
 // These are assumed to be portable, so we don't include a wrapper.
 extern "C" {
@@ -0,0 +1,644 @@
+// threadedsim.cc
+//	Direct-threaded execution engine for user programs, selected
+//	with "-engine threaded".  It is also the slow path of the JIT
+//	engine ("-engine jit", see jitsim.cc).
+//
+//	Every handler below reproduces exactly the corresponding case of
+//	the switch in Machine::ExecuteInstruction (mipssim.cc), including
+//	the delayed load and the program counter update, so that the two
+//	engines are interchangeable at any instruction boundary.
+//	Instructions that are rare in compiled C code (overflow-checking
+//	arithmetic, divisions, unaligned loads and stores, ...) are simply
+//	handed back to ExecuteInstruction.
+//
+//	Time is still accounted for one instruction at a time, with
+//	Machine::InstructionDone(), so interrupts and context switches
+//	happen at the same points as with the interpreter.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifdef CHANGED
+
+#include "copyright.h"
+#include "machine.h"
+#include "mipssim.h"
+#include "threadedsim.h"
+#include "system.h"
+
+//----------------------------------------------------------------------
+// Retire
+// 	Common tail of every instruction: apply the pending delayed load,
+//	record the new one, and advance the program counters.
+//----------------------------------------------------------------------
+
+static inline void
+Retire(int *r, int nextLoadReg, int nextLoadValue, int pcAfter)
+{
+    r[r[LoadReg]] = r[LoadValueReg];
+    r[LoadReg] = nextLoadReg;
+    r[LoadValueReg] = nextLoadValue;
+    r[0] = 0;
+    r[PrevPCReg] = r[PCReg];
+    r[PCReg] = r[NextPCReg];
+    r[NextPCReg] = pcAfter;
+}
+
+//----------------------------------------------------------------------
+// Instruction handlers
+//----------------------------------------------------------------------
+
+static void
+DoGeneric(Machine *m, ThreadedOp *op)
+{
+    m->ExecuteInstruction(&op->instr);
+}
+
+static void
+DoADDIU(Machine *m, ThreadedOp *op)
+{
+    int *r = m->registers;
+    r[op->rt] = r[op->rs] + op->imm;
+    Retire(r, 0, 0, r[NextPCReg] + 4);
+}
+
+static void
+DoADDU(Machine *m, ThreadedOp *op)
+{
+    int *r = m->registers;
+    r[op->rd] = r[op->rs] + r[op->rt];
+    Retire(r, 0, 0, r[NextPCReg] + 4);
+}
+
+static void
+DoSUBU(Machine *m, ThreadedOp *op)
+{
+    int *r = m->registers;
+    r[op->rd] = r[op->rs] - r[op->rt];
+    Retire(r, 0, 0, r[NextPCReg] + 4);
+}
+
+static void
+DoAND(Machine *m, ThreadedOp *op)
+{
+    int *r = m->registers;
+    r[op->rd] = r[op->rs] & r[op->rt];
+    Retire(r, 0, 0, r[NextPCReg] + 4);
+}
+
+static void
+DoANDI(Machine *m, ThreadedOp *op)
+{
+    int *r = m->registers;
+    r[op->rt] = r[op->rs] & op->imm;
+    Retire(r, 0, 0, r[NextPCReg] + 4);
+}
+
+static void
+DoOR(Machine *m, ThreadedOp *op)
+{
+    int *r = m->registers;
+    r[op->rd] = r[op->rs] | r[op->rt];
+    Retire(r, 0, 0, r[NextPCReg] + 4);
+}
+
+static void
+DoORI(Machine *m, ThreadedOp *op)
+{
+    int *r = m->registers;
+    r[op->rt] = r[op->rs] | op->imm;
+    Retire(r, 0, 0, r[NextPCReg] + 4);
+}
+
+static void
+DoXOR(Machine *m, ThreadedOp *op)
+{
+    int *r = m->registers;
+    r[op->rd] = r[op->rs] ^ r[op->rt];
+    Retire(r, 0, 0, r[NextPCReg] + 4);
+}
+
+static void
+DoXORI(Machine *m, ThreadedOp *op)
+{
+    int *r = m->registers;
+    r[op->rt] = r[op->rs] ^ op->imm;
+    Retire(r, 0, 0, r[NextPCReg] + 4);
+}
+
+static void
+DoNOR(Machine *m, ThreadedOp *op)
+{
+    int *r = m->registers;
+    r[op->rd] = ~(r[op->rs] | r[op->rt]);
+    Retire(r, 0, 0, r[NextPCReg] + 4);
+}
+
+static void
+DoLUI(Machine *m, ThreadedOp *op)
+{
+    int *r = m->registers;
+    r[op->rt] = op->imm;
+    Retire(r, 0, 0, r[NextPCReg] + 4);
+}
+
+static void
+DoSLL(Machine *m, ThreadedOp *op)
+{
+    int *r = m->registers;
+    r[op->rd] = r[op->rt] << op->imm;
+    Retire(r, 0, 0, r[NextPCReg] + 4);
+}
+
+static void
+DoSRL(Machine *m, ThreadedOp *op)
+{
+    int *r = m->registers;
+    r[op->rd] = (unsigned) r[op->rt] >> op->imm;
+    Retire(r, 0, 0, r[NextPCReg] + 4);
+}
+
+static void
+DoSRA(Machine *m, ThreadedOp *op)
+{
+    int *r = m->registers;
+    r[op->rd] = r[op->rt] >> op->imm;
+    Retire(r, 0, 0, r[NextPCReg] + 4);
+}
+
+static void
+DoSLLV(Machine *m, ThreadedOp *op)
+{
+    int *r = m->registers;
+    r[op->rd] = r[op->rt] << (r[op->rs] & 0x1f);
+    Retire(r, 0, 0, r[NextPCReg] + 4);
+}
+
+static void
+DoSRLV(Machine *m, ThreadedOp *op)
+{
+    int *r = m->registers;
+    r[op->rd] = (unsigned) r[op->rt] >> (r[op->rs] & 0x1f);
+    Retire(r, 0, 0, r[NextPCReg] + 4);
+}
+
+static void
+DoSRAV(Machine *m, ThreadedOp *op)
+{
+    int *r = m->registers;
+    r[op->rd] = r[op->rt] >> (r[op->rs] & 0x1f);
+    Retire(r, 0, 0, r[NextPCReg] + 4);
+}
+
+static void
+DoSLT(Machine *m, ThreadedOp *op)
+{
+    int *r = m->registers;
+    r[op->rd] = (r[op->rs] < r[op->rt]) ? 1 : 0;
+    Retire(r, 0, 0, r[NextPCReg] + 4);
+}
+
+static void
+DoSLTU(Machine *m, ThreadedOp *op)
+{
+    int *r = m->registers;
+    r[op->rd] = ((unsigned) r[op->rs] < (unsigned) r[op->rt]) ? 1 : 0;
+    Retire(r, 0, 0, r[NextPCReg] + 4);
+}
+
+static void
+DoSLTI(Machine *m, ThreadedOp *op)
+{
+    int *r = m->registers;
+    r[op->rt] = (r[op->rs] < op->imm) ? 1 : 0;
+    Retire(r, 0, 0, r[NextPCReg] + 4);
+}
+
+static void
+DoSLTIU(Machine *m, ThreadedOp *op)
+{
+    int *r = m->registers;
+    r[op->rt] = ((unsigned) r[op->rs] < (unsigned) op->imm) ? 1 : 0;
+    Retire(r, 0, 0, r[NextPCReg] + 4);
+}
+
+static void
+DoMFHI(Machine *m, ThreadedOp *op)
+{
+    int *r = m->registers;
+    r[op->rd] = r[HiReg];
+    Retire(r, 0, 0, r[NextPCReg] + 4);
+}
+
+static void
+DoMFLO(Machine *m, ThreadedOp *op)
+{
+    int *r = m->registers;
+    r[op->rd] = r[LoReg];
+    Retire(r, 0, 0, r[NextPCReg] + 4);
+}
+
+static void
+DoBEQ(Machine *m, ThreadedOp *op)
+{
+    int *r = m->registers;
+    int pcAfter = r[NextPCReg] + 4;
+    if (r[op->rs] == r[op->rt])
+	pcAfter = r[NextPCReg] + op->imm;
+    Retire(r, 0, 0, pcAfter);
+}
+
+static void
+DoBNE(Machine *m, ThreadedOp *op)
+{
+    int *r = m->registers;
+    int pcAfter = r[NextPCReg] + 4;
+    if (r[op->rs] != r[op->rt])
+	pcAfter = r[NextPCReg] + op->imm;
+    Retire(r, 0, 0, pcAfter);
+}
+
+static void
+DoBLEZ(Machine *m, ThreadedOp *op)
+{
+    int *r = m->registers;
+    int pcAfter = r[NextPCReg] + 4;
+    if (r[op->rs] <= 0)
+	pcAfter = r[NextPCReg] + op->imm;
+    Retire(r, 0, 0, pcAfter);
+}
+
+static void
+DoBGTZ(Machine *m, ThreadedOp *op)
+{
+    int *r = m->registers;
+    int pcAfter = r[NextPCReg] + 4;
+    if (r[op->rs] > 0)
+	pcAfter = r[NextPCReg] + op->imm;
+    Retire(r, 0, 0, pcAfter);
+}
+
+static void
+DoBLTZ(Machine *m, ThreadedOp *op)
+{
+    int *r = m->registers;
+    int pcAfter = r[NextPCReg] + 4;
+    if (r[op->rs] & SIGN_BIT)
+	pcAfter = r[NextPCReg] + op->imm;
+    Retire(r, 0, 0, pcAfter);
+}
+
+static void
+DoBGEZ(Machine *m, ThreadedOp *op)
+{
+    int *r = m->registers;
+    int pcAfter = r[NextPCReg] + 4;
+    if (!(r[op->rs] & SIGN_BIT))
+	pcAfter = r[NextPCReg] + op->imm;
+    Retire(r, 0, 0, pcAfter);
+}
+
+static void
+DoJ(Machine *m, ThreadedOp *op)
+{
+    int *r = m->registers;
+    Retire(r, 0, 0, ((r[NextPCReg] + 4) & 0xf0000000) | op->imm);
+}
+
+static void
+DoJAL(Machine *m, ThreadedOp *op)
+{
+    int *r = m->registers;
+    r[R31] = r[NextPCReg] + 4;
+    Retire(r, 0, 0, ((r[NextPCReg] + 4) & 0xf0000000) | op->imm);
+}
+
+static void
+DoJR(Machine *m, ThreadedOp *op)
+{
+    int *r = m->registers;
+    Retire(r, 0, 0, r[op->rs]);
+}
+
+static void
+DoJALR(Machine *m, ThreadedOp *op)
+{
+    int *r = m->registers;
+    r[op->rd] = r[NextPCReg] + 4;
+    Retire(r, 0, 0, r[op->rs]);		// rs is read after rd is written,
+					// as in the interpreter
+}
+
+static void
+DoLW(Machine *m, ThreadedOp *op)
+{
+    int *r = m->registers;
+    int addr = r[op->rs] + op->imm;
+    int value;
+
+    if (addr & 0x3) {
+	m->RaiseException(AddressErrorException, addr);
+	return;
+    }
+    if (!m->ReadMem(addr, 4, &value))
+	return;
+    Retire(r, op->rt, value, r[NextPCReg] + 4);
+}
+
+static void
+DoLB(Machine *m, ThreadedOp *op)
+{
+    int *r = m->registers;
+    int value;
+
+    if (!m->ReadMem(r[op->rs] + op->imm, 1, &value))
+	return;
+    if (value & 0x80)
+	value |= 0xffffff00;
+    else
+	value &= 0xff;
+    Retire(r, op->rt, value, r[NextPCReg] + 4);
+}
+
+static void
+DoLBU(Machine *m, ThreadedOp *op)
+{
+    int *r = m->registers;
+    int value;
+
+    if (!m->ReadMem(r[op->rs] + op->imm, 1, &value))
+	return;
+    Retire(r, op->rt, value & 0xff, r[NextPCReg] + 4);
+}
+
+static void
+DoSW(Machine *m, ThreadedOp *op)
+{
+    int *r = m->registers;
+
+    if (!m->WriteMem((unsigned) (r[op->rs] + op->imm), 4, r[op->rt]))
+	return;
+    Retire(r, 0, 0, r[NextPCReg] + 4);
+}
+
+static void
+DoSB(Machine *m, ThreadedOp *op)
+{
+    int *r = m->registers;
+
+    if (!m->WriteMem((unsigned) (r[op->rs] + op->imm), 1, r[op->rt]))
+	return;
+    Retire(r, 0, 0, r[NextPCReg] + 4);
+}
+
+//----------------------------------------------------------------------
+// IsBlockEnd
+// 	Does the instruction change the flow of control?  A block ends
+//	right after the delay slot of such an instruction.
+//----------------------------------------------------------------------
+
+static bool
+IsBlockEnd(int opCode)
+{
+    switch (opCode) {
+      case OP_BEQ: case OP_BNE: case OP_BLEZ: case OP_BGTZ:
+      case OP_BLTZ: case OP_BGEZ: case OP_BLTZAL: case OP_BGEZAL:
+      case OP_J: case OP_JAL: case OP_JR: case OP_JALR:
+      case OP_SYSCALL: case OP_RES: case OP_UNIMP:
+	return TRUE;
+      default:
+	return FALSE;
+    }
+}
+
+//----------------------------------------------------------------------
+// Prepare
+// 	Select the handler for "op" and extract its operands from the
+//	decoded instruction.
+//----------------------------------------------------------------------
+
+static void
+Prepare(ThreadedOp *op)
+{
+    Instruction *instr = &op->instr;
+
+    op->rs = instr->rs;
+    op->rt = instr->rt;
+    op->rd = instr->rd;
+    op->imm = instr->extra;
+    switch (instr->opCode) {
+      case OP_ADDIU:	op->handler = DoADDIU; break;
+      case OP_ADDU:	op->handler = DoADDU; break;
+      case OP_SUBU:	op->handler = DoSUBU; break;
+      case OP_AND:	op->handler = DoAND; break;
+      case OP_OR:	op->handler = DoOR; break;
+      case OP_XOR:	op->handler = DoXOR; break;
+      case OP_NOR:	op->handler = DoNOR; break;
+      case OP_ANDI:
+	op->handler = DoANDI;
+	op->imm = instr->extra & 0xffff;
+	break;
+      case OP_ORI:
+	op->handler = DoORI;
+	op->imm = instr->extra & 0xffff;
+	break;
+      case OP_XORI:
+	op->handler = DoXORI;
+	op->imm = instr->extra & 0xffff;
+	break;
+      case OP_LUI:
+	op->handler = DoLUI;
+	op->imm = instr->extra << 16;
+	break;
+      case OP_SLL:	op->handler = DoSLL; break;
+      case OP_SRL:	op->handler = DoSRL; break;
+      case OP_SRA:	op->handler = DoSRA; break;
+      case OP_SLLV:	op->handler = DoSLLV; break;
+      case OP_SRLV:	op->handler = DoSRLV; break;
+      case OP_SRAV:	op->handler = DoSRAV; break;
+      case OP_SLT:	op->handler = DoSLT; break;
+      case OP_SLTU:	op->handler = DoSLTU; break;
+      case OP_SLTI:	op->handler = DoSLTI; break;
+      case OP_SLTIU:	op->handler = DoSLTIU; break;
+      case OP_MFHI:	op->handler = DoMFHI; break;
+      case OP_MFLO:	op->handler = DoMFLO; break;
+      case OP_BEQ:
+	op->handler = DoBEQ;
+	op->imm = IndexToAddr(instr->extra);
+	break;
+      case OP_BNE:
+	op->handler = DoBNE;
+	op->imm = IndexToAddr(instr->extra);
+	break;
+      case OP_BLEZ:
+	op->handler = DoBLEZ;
+	op->imm = IndexToAddr(instr->extra);
+	break;
+      case OP_BGTZ:
+	op->handler = DoBGTZ;
+	op->imm = IndexToAddr(instr->extra);
+	break;
+      case OP_BLTZ:
+	op->handler = DoBLTZ;
+	op->imm = IndexToAddr(instr->extra);
+	break;
+      case OP_BGEZ:
+	op->handler = DoBGEZ;
+	op->imm = IndexToAddr(instr->extra);
+	break;
+      case OP_J:
+	op->handler = DoJ;
+	op->imm = IndexToAddr(instr->extra);
+	break;
+      case OP_JAL:
+	op->handler = DoJAL;
+	op->imm = IndexToAddr(instr->extra);
+	break;
+      case OP_JR:	op->handler = DoJR; break;
+      case OP_JALR:	op->handler = DoJALR; break;
+      case OP_LW:	op->handler = DoLW; break;
+      case OP_LB:	op->handler = DoLB; break;
+      case OP_LBU:	op->handler = DoLBU; break;
+      case OP_SW:	op->handler = DoSW; break;
+      case OP_SB:	op->handler = DoSB; break;
+      default:		op->handler = DoGeneric; break;
+    }
+}
+
+//----------------------------------------------------------------------
+// ThreadedBlock::ThreadedBlock
+// 	Allocate a block of "count" instructions starting at physical
+//	address "start".  The caller fills in the records.
+//----------------------------------------------------------------------
+
+ThreadedBlock::ThreadedBlock(int start, int count)
+{
+    physStart = start;
+    numOps = count;
+    ops = new ThreadedOp[count];
+    entryCount = 0;
+    native = NULL;
+    branchIndex = -1;
+}
+
+ThreadedBlock::~ThreadedBlock()
+{
+    delete [] ops;
+}
+
+//----------------------------------------------------------------------
+// Machine::BuildBlock
+// 	Translate the basic block starting at physical address
+//	"physAddr" into threaded code.  The block stops after the delay
+//	slot of the first control transfer, or at the end of the page,
+//	whichever comes first -- so a block never spans two frames.
+//----------------------------------------------------------------------
+
+ThreadedBlock *
+Machine::BuildBlock(int physAddr)
+{
+    int pageEnd = (physAddr / PageSize + 1) * PageSize;
+    int count, addr, slot;
+    bool delaySlot = FALSE;
+
+    // find the extent of the block, decoding as we go
+    for (addr = physAddr, count = 0; addr < pageEnd; addr += 4) {
+	slot = addr / 4;
+	if (!decodedValid[slot]) {
+	    decodedInstrs[slot].value =
+		WordToHost(*(unsigned int *) &mainMemory[addr]);
+	    decodedInstrs[slot].Decode();
+	    decodedValid[slot] = TRUE;
+	    MarkDecoded(addr / PageSize);
+	}
+	count++;
+	if (delaySlot)
+	    break;
+	if (IsBlockEnd(decodedInstrs[slot].opCode)) {
+	    if (decodedInstrs[slot].opCode == OP_SYSCALL ||
+		decodedInstrs[slot].opCode == OP_RES ||
+		decodedInstrs[slot].opCode == OP_UNIMP)
+		break;			// traps have no delay slot
+	    delaySlot = TRUE;
+	}
+    }
+
+    ThreadedBlock *block = new ThreadedBlock(physAddr, count);
+    for (int i = 0; i < count; i++) {
+	block->ops[i].instr = decodedInstrs[physAddr / 4 + i];
+	Prepare(&block->ops[i]);
+    }
+    blockAt[physAddr / 4] = block;
+    DEBUG('m', "Threaded block at 0x%x, %d instructions\n", physAddr, count);
+    return block;
+}
+
+//----------------------------------------------------------------------
+// Machine::FreeBlocks
+// 	Throw away every threaded block starting in physical page "frame".
+//----------------------------------------------------------------------
+
+void
+Machine::FreeBlocks(int frame)
+{
+    for (int i = 0; i < PageSize / 4; i++) {
+	int slot = frame * (PageSize / 4) + i;
+	if (blockAt[slot] != NULL) {
+	    delete blockAt[slot];
+	    blockAt[slot] = NULL;
+	}
+    }
+}
+
+//----------------------------------------------------------------------
+// Machine::RunThreaded
+// 	Main loop of the threaded engine; never returns.
+//
+//	We look up (or build) the block at the current PC, then run its
+//	handlers in sequence, ticking the clock after each one, as long
+//	as control keeps flowing sequentially through the block.  We go
+//	back to the lookup as soon as the PC leaves the block, or the
+//	mapping epoch changes: an exception was raised (the kernel may
+//	have changed anything), another thread was run, or the block
+//	itself was invalidated.  In the latter case the block has already
+//	been freed, so it must not be touched any more.
+//----------------------------------------------------------------------
+
+void
+Machine::RunThreaded()
+{
+    for (;;) {
+	int physAddr;
+	ExceptionType exception;
+
+	exception = Translate(registers[PCReg], &physAddr, 4, FALSE);
+	if (exception != NoException) {
+	    RaiseException(exception, registers[PCReg]);
+	    InstructionDone();
+	    continue;
+	}
+	ThreadedBlock *block = blockAt[physAddr / 4];
+	if (block == NULL)
+	    block = BuildBlock(physAddr);
+	if (engine == JitEngine && RunCompiled(block))
+	    continue;
+
+	ThreadedOp *op = block->ops;
+	int count = block->numOps;
+	int pc = registers[PCReg];
+	unsigned int epoch = mappingEpoch;
+
+	for (;;) {
+	    (*op->handler)(this, op);
+	    InstructionDone();
+	    pc += 4;
+	    if (--count == 0 || epoch != mappingEpoch ||
+		registers[PCReg] != pc)
+		break;
+	    op++;
+	}
+    }
+}
+
+#endif // CHANGED
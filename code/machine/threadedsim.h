@@ -0,0 +1,69 @@
+// threadedsim.h
+//	Data structures for the direct-threaded execution engine.
+//
+//	Instead of fetching, decoding and dispatching through a switch
+//	for every instruction, the threaded engine translates each basic
+//	block of user code once into an array of ThreadedOp records.
+//	Each record holds a pointer to the routine simulating the
+//	instruction, and its operands already extracted from the
+//	instruction word (register numbers, masked or shifted immediates,
+//	branch offsets).  Running a block is then just calling the
+//	handlers one after the other.
+//
+//	Blocks are keyed by the physical address of their first
+//	instruction, and thrown away together with the predecoded
+//	instructions of their page (see Machine::InvalidateDecodedPage).
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifdef CHANGED
+
+#ifndef THREADEDSIM_H
+#define THREADEDSIM_H
+
+#include "copyright.h"
+#include "machine.h"
+
+class ThreadedOp;
+
+// Host code generated for a block by the JIT engine (jitsim.cc).
+// Returns the number of instructions it executed.
+typedef int (*JitFunction)();
+
+// Simulate one instruction, including the delayed load and the
+// program counter update.  Exceptions are raised by the handler itself,
+// exactly as in Machine::OneInstruction.
+typedef void (*ThreadedHandler)(Machine *m, ThreadedOp *op);
+
+class ThreadedOp {
+  public:
+    ThreadedHandler handler;	// routine simulating this instruction
+    int rs, rt, rd;		// register operands
+    int imm;			// immediate, ready to use: sign-extended,
+				// masked, shifted or converted to a
+				// byte offset depending on the opcode
+    Instruction instr;		// decoded form, for the instructions
+				// without a dedicated handler
+};
+
+class ThreadedBlock {
+  public:
+    ThreadedBlock(int start, int count);
+    ~ThreadedBlock();
+
+    int physStart;		// physical address of the first instruction
+    int numOps;			// number of instructions in the block
+    ThreadedOp *ops;		// one record per instruction
+
+    int entryCount;		// times entered, -1 if it cannot be
+				// compiled (JIT engine only)
+    JitFunction native;		// compiled code, or NULL
+    int branchIndex;		// index of the final branch, if any,
+				// -1 otherwise
+};
+
+#endif // THREADEDSIM_H
+
+#endif // CHANGED
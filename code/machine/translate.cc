@@ -91,6 +91,24 @@ Machine::ReadMem(int addr, int size, int *value)
     ExceptionType exception;
     int physicalAddress;
     
+#ifdef CHANGED
+    char *host = SoftTranslate(addr, size, FALSE);
+    if (host != NULL) {			// fast path
+	switch (size) {
+	  case 1:
+	    *value = *host;
+	    break;
+	  case 2:
+	    *value = ShortToHost(*(unsigned short *) host);
+	    break;
+	  default:
+	    *value = WordToHost(*(unsigned int *) host);
+	    break;
+	}
+	return TRUE;
+    }
+#endif
+
     DEBUG('a', "Reading VA 0x%x, size %d\n", addr, size);
     
     exception = Translate(addr, &physicalAddress, size, FALSE);
@@ -140,6 +158,25 @@ Machine::WriteMem(int addr, int size, int value)
     ExceptionType exception;
     int physicalAddress;
      
+#ifdef CHANGED
+    char *host = SoftTranslate(addr, size, TRUE);
+    if (host != NULL) {			// fast path, never on a page
+	switch (size) {			// holding decoded instructions
+	  case 1:
+	    *host = (unsigned char) (value & 0xff);
+	    break;
+	  case 2:
+	    *(unsigned short *) host
+		    = ShortToMachine((unsigned short) (value & 0xffff));
+	    break;
+	  default:
+	    *(unsigned int *) host = WordToMachine((unsigned int) value);
+	    break;
+	}
+	return TRUE;
+    }
+#endif
+
     DEBUG('a', "Writing VA 0x%x, size %d, value 0x%x\n", addr, size, value);
 
     exception = Translate(addr, &physicalAddress, size, TRUE);
@@ -164,6 +201,13 @@ Machine::WriteMem(int addr, int size, int value)
 	
       default: ASSERT(FALSE);
     }
+
+#ifdef CHANGED
+    // self-modifying code, or a data page that used to hold code:
+    // the predecoded instructions of that frame are now stale
+    if (decodedPage[physicalAddress / PageSize])
+	InvalidateDecodedPage(physicalAddress / PageSize);
+#endif
     
     return TRUE;
 }
@@ -199,16 +243,27 @@ Machine::Translate(int virtAddr, int* physAddr, int size, bool writing)
 	return AddressErrorException;
     }
     
+#ifdef CHANGED
+    // with a TLB, the kernel still reaches user memory through the
+    // page table of the current address space (see EnableTLB)
+    bool useTLB = (tlb != NULL && interrupt->getStatus() == UserMode);
+    ASSERT(useTLB || pageTable != NULL);
+#else
     // we must have either a TLB or a page table, but not both!
     ASSERT(tlb == NULL || pageTable == NULL);	
     ASSERT(tlb != NULL || pageTable != NULL);	
+#endif
 
 // calculate the virtual page number, and offset within the page,
 // from the virtual address
     vpn = (unsigned) virtAddr / PageSize;
     offset = (unsigned) virtAddr % PageSize;
     
+#ifdef CHANGED
+    if (!useTLB) {
+#else
     if (tlb == NULL) {		// => page table => vpn is index into table
+#endif
 	if (vpn >= pageTableSize) {
 	    DEBUG('a', "virtual page # %d too large for page table size %d!\n", 
 			virtAddr, pageTableSize);
@@ -220,17 +275,28 @@ Machine::Translate(int virtAddr, int* physAddr, int size, bool writing)
 	}
 	entry = &pageTable[vpn];
     } else {
+#ifdef CHANGED
+	int set = vpn % tlbSets;	// only look at the ways of its set
+        for (entry = NULL, i = set * tlbWays; i < (set + 1) * tlbWays; i++)
+#else
         for (entry = NULL, i = 0; i < TLBSize; i++)
+#endif
     	    if (tlb[i].valid && (tlb[i].virtualPage == vpn)) {
 		entry = &tlb[i];			// FOUND!
 		break;
 	    }
 	if (entry == NULL) {				// not found
     	    DEBUG('a', "*** no valid TLB entry found for this virtual page!\n");
+#ifdef CHANGED
+	    stats->numTLBMisses++;
+#endif
     	    return PageFaultException;		// really, this is a TLB fault,
 						// the page may be in memory,
 						// but not in the TLB
 	}
+#ifdef CHANGED
+	stats->numTLBHits++;
+#endif
     }
 
     if (entry->readOnly && writing) {	// trying to write to a read-only page
@@ -251,5 +317,151 @@ Machine::Translate(int virtAddr, int* physAddr, int size, bool writing)
     *physAddr = pageFrame * PageSize + offset;
     ASSERT((*physAddr >= 0) && ((*physAddr + size) <= MemorySize));
     DEBUG('a', "phys addr = 0x%x\n", *physAddr);
+#ifdef CHANGED
+    // keep tracing every access, and counting every TLB lookup
+    if (tlb == NULL && !DebugIsEnabled('a'))
+	FillSoftMMU(vpn, pageFrame, writing);
+#endif
     return NoException;
 }
+
+#ifdef CHANGED
+//----------------------------------------------------------------------
+// Machine::EnableTLB
+// 	Make user programs translate their addresses through a TLB of
+//	"size" entries, split into sets of "ways" entries: virtual page
+//	"vpn" can only be held by set "vpn % (size / ways)", so a lookup
+//	only compares "ways" entries.
+//
+//	A miss raises a PageFaultException, and the kernel refills the
+//	TLB from machine->pageTable with LoadTLB.  The page table stays
+//	installed while the TLB is in use: it is what kernel code
+//	(system calls copying user buffers) translates through, without
+//	touching the TLB.
+//----------------------------------------------------------------------
+
+void
+Machine::EnableTLB(int size, int ways)
+{
+    ASSERT(size > 0 && ways > 0 && size % ways == 0);
+    if (tlb != NULL)
+	delete [] tlb;
+    delete [] tlbVictim;
+
+    tlbWays = ways;
+    tlbSets = size / ways;
+    tlb = new TranslationEntry[size];
+    for (int i = 0; i < size; i++)
+	tlb[i].valid = FALSE;
+    tlbVictim = new int[tlbSets];
+    for (int i = 0; i < tlbSets; i++)
+	tlbVictim[i] = 0;
+    MappingChanged();
+}
+
+//----------------------------------------------------------------------
+// Machine::WriteBackTLBEntry
+// 	Report the use and dirty bits of TLB entry "entry" to the page
+//	table, before the entry is dropped.
+//----------------------------------------------------------------------
+
+void
+Machine::WriteBackTLBEntry(TranslationEntry *entry)
+{
+    if (!entry->valid || pageTable == NULL
+	|| entry->virtualPage >= pageTableSize)
+	return;
+    TranslationEntry *pte = &pageTable[entry->virtualPage];
+    if (pte->physicalPage != entry->physicalPage)
+	return;				// the page has moved meanwhile
+    pte->use = pte->use || entry->use;
+    pte->dirty = pte->dirty || entry->dirty;
+}
+
+//----------------------------------------------------------------------
+// Machine::LoadTLB
+// 	Copy the page table entry "entry" into the set of its virtual
+//	page, in a free way if there is one, otherwise in place of the
+//	entries of the set in turn (FIFO replacement).
+//----------------------------------------------------------------------
+
+void
+Machine::LoadTLB(TranslationEntry *entry)
+{
+    int set = entry->virtualPage % tlbSets;
+    int first = set * tlbWays;
+    int way;
+
+    ASSERT(tlb != NULL);
+    for (way = 0; way < tlbWays; way++)
+	if (!tlb[first + way].valid)
+	    break;
+    if (way == tlbWays) {
+	way = tlbVictim[set];
+	tlbVictim[set] = (way + 1) % tlbWays;
+	WriteBackTLBEntry(&tlb[first + way]);
+    }
+    tlb[first + way] = *entry;
+    MappingChanged();
+}
+
+//----------------------------------------------------------------------
+// Machine::FlushTLB
+// 	Empty the TLB, writing the use and dirty bits of its entries back
+//	to the current page table.  Called when the address space is
+//	switched out; anyone editing a page table entry that may be in
+//	the TLB must call it too.
+//----------------------------------------------------------------------
+
+void
+Machine::FlushTLB()
+{
+    if (tlb == NULL)
+	return;
+    for (int i = 0; i < tlbSets * tlbWays; i++) {
+	WriteBackTLBEntry(&tlb[i]);
+	tlb[i].valid = FALSE;
+    }
+    MappingChanged();
+}
+
+//----------------------------------------------------------------------
+// Machine::FillSoftMMU
+// 	Remember that virtual page "vpn" has just been translated to
+//	"frame", for a read or, if "writing", a write.
+//
+//	Translate has set the use bit (and the dirty bit on a write), so
+//	the fast path may skip them until the next MappingChanged().  A
+//	write permission is only granted on frames without decoded
+//	instructions, whose writes must go through the slow path of
+//	WriteMem to invalidate them.
+//----------------------------------------------------------------------
+
+void
+Machine::FillSoftMMU(int vpn, int frame, bool writing)
+{
+    SoftMMUEntry *e = &softMMU[vpn % SoftMMUSize];
+
+    if (e->readTag != vpn && e->writeTag != vpn)
+	e->writeTag = -1;		// evicting another page
+    e->readTag = vpn;
+    e->frame = frame;
+    e->host = &mainMemory[frame * PageSize];
+    if (writing && !decodedPage[frame])
+	e->writeTag = vpn;
+}
+
+//----------------------------------------------------------------------
+// Machine::FlushSoftMMU
+// 	Forget every cached translation.
+//----------------------------------------------------------------------
+
+void
+Machine::FlushSoftMMU()
+{
+    for (int i = 0; i < SoftMMUSize; i++) {
+	softMMU[i].readTag = -1;
+	softMMU[i].writeTag = -1;
+    }
+}
+#endif
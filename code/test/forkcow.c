@@ -0,0 +1,33 @@
+#include "syscall.h"
+
+// A large array, so that duplicating the address space would be costly
+// if it were copied.  Parent and child each write to part of it: only
+// the pages written are copied.
+#define N 4096
+
+int data[N];
+
+int main() {
+
+  int i, pid;
+
+  for (i = 0; i < N; i++)
+    data[i] = i;
+
+  pid = ForkProcess();
+  if (pid == 0) {
+    data[0] = -1;
+    PutString("child: ");
+    PutInt(data[0]);
+    PutInt(data[N - 1]);
+    PutChar('\n');
+    return 0;
+  }
+
+  JoinExec(pid);
+  PutString("parent: ");
+  PutInt(data[0]);
+  PutInt(data[N - 1]);
+  PutChar('\n');
+  return 0;
+}
@@ -0,0 +1,46 @@
+#include "syscall.h"
+
+// Fill a file through a mapping, unmap it, map it again and check the
+// contents: they must have been written back to the file.
+
+#define SIZE 1000
+
+int main() {
+
+  char buffer[100];
+  char *p;
+  int fd, i, sum, n;
+
+  Create("mmapfile");
+  fd = Open("mmapfile");
+  if (fd == -1) {
+    PutString("cannot open mmapfile\n");
+    return 0;
+  }
+  // give the file its size
+  for (i = 0; i < 100; i++)
+    buffer[i] = 0;
+  for (n = 0; n < SIZE; n += 100)
+    Write(buffer, 100, fd);
+
+  p = (char *) Mmap(fd, SIZE);
+  if ((int) p == -1) {
+    PutString("Mmap failed\n");
+    return 0;
+  }
+  for (i = 0; i < SIZE; i++)
+    p[i] = i % 10;
+  Munmap((int) p);
+
+  p = (char *) Mmap(fd, SIZE);
+  sum = 0;
+  for (i = 0; i < SIZE; i++)
+    sum += p[i];
+  Munmap((int) p);
+  Close(fd);
+
+  PutString("sum (should be 4500): ");
+  PutInt(sum);
+  PutChar('\n');
+  return 0;
+}
@@ -24,6 +24,11 @@
 //    -s causes user programs to be executed in single-step mode
 //    -x runs a user program
 //    -c tests the console
+//    -engine <interp|threaded|jit> selects how user instructions are executed
+//    -bt advances the clock in bulk between pending interrupts, instead of
+//       calling OneTick() after each user instruction
+//    -tlb <size>[,<ways>] translates user addresses through a TLB of <size>
+//       entries, in sets of <ways> entries (fully associative by default)
 //
 //  FILESYS
 //    -f causes the physical disk to be formatted
@@ -33,6 +38,10 @@
 //    -l lists the contents of the Nachos directory
 //    -D prints the contents of the entire file system 
 //    -t tests the performance of the Nachos file system
+//    -ds compares the seek time of the FIFO and C-LOOK disk schedules
+//    -sf compares the seek time of the block placement policies on small files
+//    -mmap accesses the DISK file through a memory mapping, instead of a
+//       read or write system call per sector (the simulated time is the same)
 //    -md Creates a new Directory 
 //
 //  NETWORK
@@ -77,6 +86,8 @@ extern void Test_FileSystem2();
 extern void Test_FileSystem3();
 extern void nachcopy (const char* from, const char* to);
 extern void formatfilesys ();
+extern void DiskScheduleTest ();
+extern void SmallFileTest ();
 #endif
 
 extern void MailWait (int networkID);
@@ -257,6 +268,18 @@ main (int argc, char **argv)
 		    PerformanceTest ();
 		    interrupt->Halt ();
 	    }
+#ifdef CHANGED
+      else if (!strcmp (*argv, "-ds"))
+	    {			// disk scheduling benchmark
+		    DiskScheduleTest ();
+		    interrupt->Halt ();
+	    }
+      else if (!strcmp (*argv, "-sf"))
+	    {			// block placement benchmark
+		    SmallFileTest ();
+		    interrupt->Halt ();
+	    }
+#endif
 	  
 #endif // FILESYS
 #ifdef NETWORK
@@ -146,42 +146,49 @@ Lock::Release ()
 Condition::Condition (const char *debugName)
 {
     name = debugName;
-    CV_sleep = new Semaphore("Sleeper", 0);
     internalLock = new Semaphore("Internal Lock", 1);
-    num_sleepers = 0;
+    sleepers = new List;
 }
 
 Condition::~Condition ()
 {
     delete internalLock;
+    delete sleepers;
 }
 
 //reference: https://www.cs.umd.edu/users/hollings/cs412/s96/synch/locks.html
+// Each waiting thread sleeps on a semaphore of its own: with a single
+// one, a thread calling Wait before a thread woken up runs again would
+// take its wake-up, as P does not sleep while the value is positive.
 void
 Condition::Wait (Lock * conditionLock)
 {
+    Semaphore *sleeper = new Semaphore("Sleeper", 0);
+
     DEBUG('l', "Wait in condition with thread %d\n", currentThread->GetPID() );
     
     internalLock->P();
  
-    num_sleepers ++;
+    sleepers->Append((void *) sleeper);
     conditionLock->Release();
 
     internalLock->V();
     
-    CV_sleep->P(); //sleep
+    sleeper->P(); //sleep
+    delete sleeper;
     conditionLock->Acquire();
 }
 
 void
 Condition::Signal (Lock * conditionLock)
 {
+    Semaphore *sleeper;
+
     internalLock->P();
     
-    if (num_sleepers > 0) {
-        CV_sleep->V(); // wake up 1
-        num_sleepers --;
-    }
+    sleeper = (Semaphore *) sleepers->Remove();
+    if (sleeper != NULL)
+        sleeper->V(); // wake up 1
     
     internalLock->V();
 }
@@ -189,12 +196,12 @@ Condition::Signal (Lock * conditionLock)
 void
 Condition::Broadcast (Lock * conditionLock)
 {
+    Semaphore *sleeper;
+
     internalLock->P();
     
-    while (num_sleepers > 0) {
-        CV_sleep->V(); // wake up 1
-        num_sleepers --;
-    }
+    while ((sleeper = (Semaphore *) sleepers->Remove()) != NULL)
+        sleeper->V(); // wake up 1
     
     internalLock->V();
 }
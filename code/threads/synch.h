@@ -147,7 +147,7 @@ class Condition
     const char *name;
     // plus some other stuff you'll need to define
     Semaphore *internalLock;
-    Semaphore *CV_sleep; // queue of sleeping thread on this condition
-    int num_sleepers;
+    List *sleepers;	// a semaphore for each thread waiting on
+			// this condition, in order
 };
 #endif // SYNCH_H
@@ -27,6 +27,11 @@ FileSystem *fileSystem;
 
 #ifdef FILESYS
 SynchDisk *synchDisk;
+#ifdef CHANGED
+BufferCache *bufferCache;
+InodeTable *inodeTable;
+Journal *journal;
+#endif
 #endif
 
 #ifdef USER_PROGRAM		// requires either FILESYS or FILESYS_STUB
@@ -34,9 +39,15 @@ Machine *machine;		// user program memory and registers
 #ifdef CHANGED
 SynchConsole *synchconsole;
 FrameProvider *frameProvider;
+TextCache *textCache;
 #endif
 #endif
 
+#if defined(CHANGED) && defined(VM)
+CoreMap *coreMap;		// owner of each physical frame
+SwapFile *swapFile;		// backing store of evicted pages
+#endif
+
 #ifdef NETWORK
 PostOffice *postOffice;
 #endif
@@ -96,10 +107,18 @@ Initialize (int argc, char **argv)
 
 #ifdef USER_PROGRAM
     bool debugUserProg = FALSE;	// single step user program
+#ifdef CHANGED
+    Machine::Engine engine = Machine::InterpreterEngine;
+    bool batchTicks = FALSE;	// account for user ticks in bulk
+    int tlbSize = 0, tlbWays = 0;	// TLB geometry, 0 for none
+#endif
 #endif
 #ifdef FILESYS_NEEDED
     bool format = FALSE;	// format disk
 #endif
+#if defined(FILESYS) && defined(CHANGED)
+    bool mapDisk = FALSE;	// map the DISK file into memory
+#endif
 #ifdef NETWORK
     double rely = 1;		// network reliability
     int netname = 0;		// UNIX socket name
@@ -129,6 +148,32 @@ Initialize (int argc, char **argv)
 #ifdef USER_PROGRAM
 	  if (!strcmp (*argv, "-s"))
 	      debugUserProg = TRUE;
+#ifdef CHANGED
+	  else if (!strcmp (*argv, "-engine"))
+	    {
+		ASSERT (argc > 1);
+		if (!strcmp (*(argv + 1), "threaded"))
+		    engine = Machine::ThreadedEngine;
+		else if (!strcmp (*(argv + 1), "jit"))
+		    engine = Machine::JitEngine;
+		else if (!strcmp (*(argv + 1), "interp"))
+		    engine = Machine::InterpreterEngine;
+		else
+		    printf ("Unknown engine %s, using the interpreter\n",
+			    *(argv + 1));
+		argCount = 2;
+	    }
+	  else if (!strcmp (*argv, "-bt"))
+	      batchTicks = TRUE;
+	  else if (!strcmp (*argv, "-tlb"))
+	    {
+		ASSERT (argc > 1);
+		if (sscanf (*(argv + 1), "%d,%d", &tlbSize, &tlbWays) < 2)
+		    tlbWays = tlbSize;	// fully associative
+		ASSERT (tlbSize > 0 && tlbWays > 0 && tlbSize % tlbWays == 0);
+		argCount = 2;
+	    }
+#endif
 #endif
 /*
 #ifdef FILESYS_NEEDED
@@ -138,6 +183,10 @@ Initialize (int argc, char **argv)
       
 #endif
 */
+#if defined(FILESYS) && defined(CHANGED)
+	  if (!strcmp (*argv, "-mmap"))
+	      mapDisk = TRUE;
+#endif
 #ifdef NETWORK
 	  if (!strcmp (*argv, "-l"))
 	    {
@@ -174,22 +223,45 @@ Initialize (int argc, char **argv)
 
 #ifdef USER_PROGRAM
     machine = new Machine (debugUserProg);	// this must come first
+#ifdef CHANGED
+    machine->SetEngine (engine);
+    machine->SetBatchTicks (batchTicks);
+    if (tlbSize > 0)
+	machine->EnableTLB (tlbSize, tlbWays);
+    textCache = new TextCache (NumPhysPages);
+#endif
 #endif
 
 #ifdef CHANGED
     synchconsole = new SynchConsole(NULL, NULL);
     opentable = new OpenTable;
     frameProvider = new FrameProvider(NumPhysPages);
+#ifdef USER_PROGRAM
+    frameProvider->StartZeroing();
+#endif
 #endif
 
 #ifdef FILESYS
     synchDisk = new SynchDisk ("DISK");
+#ifdef CHANGED
+    if (mapDisk && !synchDisk->UseMapping ())
+	printf ("Cannot map the DISK file, reading and writing it\n");
+    bufferCache = new BufferCache ();
+    bufferCache->StartThreads ();
+    inodeTable = new InodeTable ();
+    journal = new Journal ();
+#endif
 #endif
 
 #ifdef FILESYS_NEEDED
     fileSystem = new FileSystem (format);
 #endif
 
+#if defined(CHANGED) && defined(VM)
+    coreMap = new CoreMap (NumPhysPages);
+    swapFile = new SwapFile ();	// the file is created when first needed
+#endif
+
 #ifdef NETWORK
     postOffice = new PostOffice (netname, rely, 10);
 #endif
@@ -207,15 +279,35 @@ Cleanup ()
     delete postOffice;
 #endif
 
-#ifdef USER_PROGRAM
-    delete machine;
+#if defined(CHANGED) && defined(VM)
+    delete coreMap;
+    delete swapFile;
 #endif
 
 #ifdef FILESYS_NEEDED
-    delete fileSystem;
+#if defined(CHANGED) && defined(FILESYS)
+    bufferCache->StopFlusher ();	// it would checkpoint fileSystem
+#endif
+    delete fileSystem;		// writes to files: before textCache goes
+#ifdef CHANGED
+    fileSystem = NULL;
+#endif
+#endif
+
+#ifdef USER_PROGRAM
+    delete machine;
+#ifdef CHANGED
+    delete textCache;
+#endif
 #endif
 
 #ifdef FILESYS
+#ifdef CHANGED
+    delete inodeTable;
+    bufferCache->Flush ();	// write back what is still dirty
+    delete journal;		// no more operations after the flush
+    delete bufferCache;
+#endif
     delete synchDisk;
 #endif
 
@@ -45,6 +45,10 @@ extern FrameProvider *frameProvider;
 #ifdef USER_PROGRAM
 #include "machine.h"
 extern Machine *machine;	// user program memory and registers
+#ifdef CHANGED
+#include "textcache.h"
+extern TextCache *textCache;	// code pages shared between processes
+#endif
 #endif
 
 #ifdef FILESYS_NEEDED		// FILESYS or FILESYS_STUB
@@ -55,6 +59,21 @@ extern FileSystem *fileSystem;
 #ifdef FILESYS
 #include "synchdisk.h"
 extern SynchDisk *synchDisk;
+#ifdef CHANGED
+#include "buffercache.h"
+#include "inodetable.h"
+#include "journal.h"
+extern BufferCache *bufferCache;	// cached sectors of synchDisk
+extern InodeTable *inodeTable;		// headers of the open files
+extern Journal *journal;		// log of the metadata updates
+#endif
+#endif
+
+#if defined(CHANGED) && defined(VM)
+#include "coremap.h"
+#include "swap.h"
+extern CoreMap *coreMap;
+extern SwapFile *swapFile;
 #endif
 
 #ifdef NETWORK
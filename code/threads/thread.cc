@@ -40,6 +40,9 @@ Thread::Thread (const char *threadName)
     stackTop = NULL;
     stack = NULL;
     status = JUST_CREATED;
+#if defined(FILESYS) && defined(CHANGED)
+    journalDepth = 0;
+#endif
 #ifdef USER_PROGRAM
     space = NULL;
     // FBT: Need to initialize special registers of simulator to 0
@@ -263,8 +266,16 @@ Thread::Sleep ()
 
     status = BLOCKED;
     
+#if defined(CHANGED) && defined(USER_PROGRAM)
+    while ((nextThread = scheduler->FindNextToRun ()) == NULL)
+      if (frameProvider == NULL || !frameProvider->CpuIdle ())
+	interrupt->Idle ();	// no one to run, not even the thread
+				// zeroing the free frames: wait for
+				// an interrupt
+#else
     while ((nextThread = scheduler->FindNextToRun ()) == NULL)
       interrupt->Idle ();	// no one to run, wait for an interrupt
+#endif
 
     scheduler->Run (nextThread);	// returns when we've been signalled
 }
@@ -116,6 +116,11 @@ class Thread
 	   printf ("%s, ", name);
     }
 
+#if defined(FILESYS) && defined(CHANGED)
+    int journalDepth;		// nesting of the file system operations
+				// in progress (see journal.h)
+#endif
+
   private:
     // some of the private data for this class is listed above
 
@@ -18,16 +18,14 @@
 #include "copyright.h"
 #include "system.h"
 #include "addrspace.h"
-#include "noff.h"
+#ifndef CHANGED
+#include "noff.h"		// else included by addrspace.h
+#endif
 #include "synch.h"
 #include "list.h"
 
 #include <strings.h>		/* for bzero */
 
-#ifdef CHANGED
-static void ReadAtVirtual(OpenFile *executable, int virtualaddr, int numBytes, int position, 
-  TranslationEntry *pageTable, unsigned numPages);
-#endif
 
 //----------------------------------------------------------------------
 // SwapHeader
@@ -64,21 +62,24 @@ SwapHeader (NoffHeader * noffH)
 //      only uniprogramming, and we have a single unsegmented page table
 //
 //      "executable" is the file containing the object code to load into memory
+//
+//      With CHANGED, nothing is loaded here: every page starts invalid
+//      and is brought in by PageIn on its first reference.  The address
+//      space then owns "executable", and closes it when deleted.
 //----------------------------------------------------------------------
 
+#ifdef CHANGED
+AddrSpace::AddrSpace (OpenFile *execFile)
+  : executable (execFile)
+{
+  unsigned int i, size;
+#else
 AddrSpace::AddrSpace (OpenFile *executable)
 {
   NoffHeader noffH;
   unsigned int i, size;
-
-#ifdef CHANGED
-   for (int x = 0;x < MAX_FILES;x++)
-   {
-         table[x].file = NULL;
-         table[x].sector = 0;
-         table[x].vacant = TRUE;
-   }
 #endif
+
   executable->ReadAt ((char *) &noffH, sizeof (noffH), 0);
   if ((noffH.noffMagic != NOFFMAGIC) && (WordToHost (noffH.noffMagic) == NOFFMAGIC))
     SwapHeader (&noffH);
@@ -88,12 +89,25 @@ AddrSpace::AddrSpace (OpenFile *executable)
   size = noffH.code.size + noffH.initData.size + noffH.uninitData.size + UserStackSize;	// we need to increase the size
   // to leave room for the stack
   numPages = divRoundUp (size, PageSize);
+#ifdef CHANGED
+  threadStacksStart = numPages;
+  numPages += MaxUserThreads * (ThreadStackPages + 1);
+  mmapStart = numPages;
+  numPages += MmapPages;
+#endif
   size = numPages * PageSize;
 
+#ifdef CHANGED
+#ifndef VM
+  ASSERT (threadStacksStart <= NumPhysPages);	// the thread stacks
+  // are only given memory when used
+#endif
+#elif !defined(VM)
   ASSERT (numPages <= NumPhysPages);	// check we're not trying
   // to run anything too big --
   // at least until we have
   // virtual memory
+#endif
 
   DEBUG ('a', "Initializing address space, num pages %d, size %d\n", numPages, size);
   // first, set up the translation 
@@ -101,19 +115,13 @@ AddrSpace::AddrSpace (OpenFile *executable)
   for (i = 0; i < numPages; i++)
   {
 	  pageTable[i].virtualPage = i;	
-    // physical page # = virtual page # + 1 // machine->frameProvider->GetEmptyFrame();
 #ifdef CHANGED
-    if (frameProvider->NumAvailFrame() > 0) {
-      int frame = frameProvider->GetEmptyFrame();
-      pageTable[i].physicalPage = frame;
-    } else {
-      // TODO proper error
-      return;
-    }
+    pageTable[i].physicalPage = 0;
+    pageTable[i].valid = FALSE;	// loaded on the first reference
 #else
     pageTable[i].physicalPage = i;
-#endif
 	  pageTable[i].valid = TRUE;
+#endif
 	  pageTable[i].use = FALSE;
 	  pageTable[i].dirty = FALSE;
 	  pageTable[i].readOnly = FALSE;	// if the code segment was entirely on 
@@ -121,6 +129,7 @@ AddrSpace::AddrSpace (OpenFile *executable)
     // pages to be read-only
   }
 
+#ifndef CHANGED
   // zero out the entire address space, to zero the unitialized data segment 
   // and the stack segment
   // bzero (machine->mainMemory, size);
@@ -128,22 +137,50 @@ AddrSpace::AddrSpace (OpenFile *executable)
   // then, copy in the code and data segments into memory
   if (noffH.code.size > 0) {
     DEBUG ('a', "Initializing code segment, at 0x%x, size %d\n", noffH.code.virtualAddr, noffH.code.size);
-#ifdef CHANGED
-    ReadAtVirtual(executable, noffH.code.virtualAddr, noffH.code.size, noffH.code.inFileAddr, pageTable, numPages);
-#else
     executable->ReadAt (&(machine->mainMemory[noffH.code.virtualAddr]), noffH.code.size, noffH.code.inFileAddr);
-#endif
   }
   if (noffH.initData.size > 0) {
     DEBUG ('a', "Initializing data segment, at 0x%x, size %d\n", noffH.initData.virtualAddr, noffH.initData.size);
-#ifdef CHANGED
-    ReadAtVirtual(executable, noffH.initData.virtualAddr, noffH.initData.size, noffH.initData.inFileAddr, pageTable, numPages);
-#else
     executable->ReadAt (&(machine->mainMemory[noffH.initData.virtualAddr]), noffH.initData.size, noffH.initData.inFileAddr);
-#endif
   }
+#endif
+
+#ifdef CHANGED
+  InitProcessState ();
+#endif   // END CHANGED
+}
 
 #ifdef CHANGED
+//----------------------------------------------------------------------
+// AddrSpace::InitProcessState
+//      Set up everything but the page table: an empty open file table,
+//      the locks, and the per-page bookkeeping.  "numPages" must be set.
+//----------------------------------------------------------------------
+
+void
+AddrSpace::InitProcessState ()
+{
+   for (int x = 0;x < MAX_FILES;x++)
+   {
+         table[x].file = NULL;
+         table[x].sector = 0;
+         table[x].vacant = TRUE;
+   }
+
+  for (int x = 0; x < MaxMmaps; x++)
+    mmaps[x].file = NULL;
+  mmapMap = new BitMap (MmapPages);
+
+  pageInLock = new Lock("PageIn lock");
+  cow = new bool[numPages];
+  for (unsigned int i = 0; i < numPages; i++)
+    cow[i] = FALSE;
+#ifdef VM
+  swapSlot = new int[numPages];
+  for (unsigned int i = 0; i < numPages; i++)
+    swapSlot[i] = -1;
+#endif
+
   // Initialize the bitmap, lock and variables
   stackBitMap = new BitMap(GetMaxNumThreads());
   stackBitMapLock = new Lock("Stack Lock");
@@ -160,9 +197,94 @@ AddrSpace::AddrSpace (OpenFile *executable)
   //Initialization of extra variable for Shell
   hasArg = false;
   arg = new char[30];
-#endif   // END CHANGED
 }
 
+//----------------------------------------------------------------------
+// AddrSpace::AddrSpace
+//      Create a copy-on-write duplicate of "parent", which must be the
+//      address space of the running thread.  No page is copied: each
+//      page in memory is mapped by both spaces, read-only, and the
+//      first one to write to it gets its own copy (see CopyOnWrite).
+//      The cost is that of copying the page table.
+//
+//      Pages not loaded yet are loaded from the executable by each
+//      space on its own.  With VM, pages on swap are copied to a swap
+//      slot of the duplicate, since the parent may overwrite its own.
+//
+//      The duplicate starts with an empty open file table, and without
+//      the mapped files of its parent.
+//----------------------------------------------------------------------
+
+AddrSpace::AddrSpace (AddrSpace *parent)
+  : executable (new OpenFile (parent->executable->fileSector ()))
+{
+  noffH = parent->noffH;
+  numPages = parent->numPages;
+  threadStacksStart = parent->threadStacksStart;
+  mmapStart = parent->mmapStart;
+  pageTable = new TranslationEntry[numPages];
+  InitProcessState ();
+
+  // the stack regions of the parent's other threads stay taken
+  for (int i = 0; i < GetMaxNumThreads (); i++)
+    if (parent->stackBitMap->Test (i))
+      stackBitMap->Mark (i);
+  if (parent->hasArg)
+    setExtraArg (parent->arg);
+
+  parent->pageInLock->Acquire ();
+#ifdef VM
+  coreMap->Acquire ();
+#endif
+  machine->FlushTLB ();		// the parent's entries are about to change
+  for (unsigned int i = mmapStart; i < numPages; i++) {
+    pageTable[i] = parent->pageTable[i];
+    pageTable[i].valid = FALSE;
+  }
+  for (unsigned int i = 0; i < mmapStart; i++) {
+    TranslationEntry *entry = &parent->pageTable[i];
+
+    if (entry->valid) {
+      if (!entry->readOnly || parent->cow[i]) {
+        entry->readOnly = TRUE;
+        parent->cow[i] = TRUE;
+        cow[i] = TRUE;
+      }
+#ifdef VM
+      coreMap->ShareFrame (entry->physicalPage);
+#else
+      frameProvider->ShareFrame (entry->physicalPage);
+#endif
+    }
+#ifdef VM
+    else if (parent->swapSlot[i] >= 0) {
+      char buffer[PageSize];
+
+      swapSlot[i] = swapFile->AllocSlot ();
+      if (swapSlot[i] < 0) {
+        printf ("Out of swap space\n");
+        ASSERT (FALSE);
+      }
+      swapFile->ReadSlot (parent->swapSlot[i], buffer);
+      swapFile->WriteSlot (swapSlot[i], buffer);
+    }
+#endif
+    pageTable[i] = *entry;
+    pageTable[i].use = FALSE;
+#ifdef VM
+    if (entry->valid)
+      pageTable[i].dirty = TRUE;	// not on swap, nor in the executable
+#endif
+  }
+  machine->MappingChanged ();
+#ifdef VM
+  coreMap->Release ();
+#endif
+  parent->pageInLock->Release ();
+  DEBUG ('a', "Duplicated address space, num pages %d\n", numPages);
+}
+#endif   // END CHANGED
+
 //----------------------------------------------------------------------
 // AddrSpace::~AddrSpace
 //      Dealloate an address space.  Nothing for now!
@@ -170,9 +292,11 @@ AddrSpace::AddrSpace (OpenFile *executable)
 
 AddrSpace::~AddrSpace ()
 {
+#ifndef CHANGED
   // LB: Missing [] for delete
   // delete pageTable;
   delete [] pageTable;
+#endif
 
 #ifdef CHANGED  
   delete stackBitMap;
@@ -185,13 +309,16 @@ AddrSpace::~AddrSpace ()
   delete openLock;
   delete threadsCountLock;
 
-  // TODO Test this more
-  unsigned int i;
-  for (i = 0; i < numPages; i++) {
-    if (pageTable[i].valid) {
-      frameProvider->ReleaseFrame(pageTable[i].physicalPage);
-    }
-  }
+  // release the frames while the page table is still there
+  ReleasePages();
+  delete mmapMap;
+  delete [] cow;
+#ifdef VM
+  delete [] swapSlot;
+#endif
+  delete [] pageTable;
+  delete pageInLock;
+  delete executable;
 #endif
   // End of modification
 }
@@ -224,8 +351,14 @@ AddrSpace::InitRegisters ()
     // Set the stack register to the end of the address space, where we
     // allocated the stack; but subtract off a bit, to make sure we don't
     // accidentally reference off the end!
+#ifdef CHANGED
+    // the thread stacks are above the main one
+    machine->WriteRegister (StackReg, threadStacksStart * PageSize - 16);
+    DEBUG ('a', "Initializing stack register to %d\n", threadStacksStart * PageSize - 16);
+#else
     machine->WriteRegister (StackReg, numPages * PageSize - 16);
     DEBUG ('a', "Initializing stack register to %d\n", numPages * PageSize - 16);
+#endif
 }
 
 //----------------------------------------------------------------------
@@ -239,6 +372,9 @@ AddrSpace::InitRegisters ()
 void
 AddrSpace::SaveState ()
 {
+#ifdef CHANGED
+    machine->FlushTLB ();	// its entries belong to this address space
+#endif
     pageTable = machine->pageTable;
     numPages = machine->pageTableSize;
 }
@@ -256,6 +392,9 @@ AddrSpace::RestoreState ()
 {
     machine->pageTable = pageTable;
     machine->pageTableSize = numPages;
+#ifdef CHANGED
+    machine->MappingChanged();
+#endif
 }
 
 
@@ -263,21 +402,46 @@ AddrSpace::RestoreState ()
 #ifdef CHANGED
 
 //----------------------------------------------------------------------
-// AddrSpace::MultiThreadSetStackPointer
-//      Use in multithread function to set the new stack pointer to
-//      new position
+// Thread stacks
+//      Above the stack of the main thread, the address space reserves
+//      MaxUserThreads regions for the stacks of the other threads.
+//      Region "location" starts with a guard page, never mapped, so
+//      that a stack overflowing into the region below faults instead
+//      of silently corrupting it; then come ThreadStackPages pages of
+//      stack.  Like every page, they only get a frame when touched,
+//      and they are released when the thread exits.
+//----------------------------------------------------------------------
+
+unsigned int
+AddrSpace::ThreadStackBase (int location)
+{
+    return threadStacksStart + location * (ThreadStackPages + 1);
+}
+
+bool
+AddrSpace::IsGuardPage (unsigned int vpn)
+{
+    return vpn >= threadStacksStart && vpn < mmapStart
+        && (vpn - threadStacksStart) % (ThreadStackPages + 1) == 0;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::SetThreadStackPointer
+//      Point the stack register at the top of thread stack "location".
 //----------------------------------------------------------------------
 
 void
-AddrSpace::MultiThreadSetStackPointer (unsigned int newPositionOffset)
+AddrSpace::SetThreadStackPointer (int location)
 {
-    machine->WriteRegister (StackReg, (numPages * PageSize - newPositionOffset) - 16);
-    DEBUG ('a', "Initializing stack register to %d\n", (numPages * PageSize - newPositionOffset) - 16);
+    int top = (ThreadStackBase (location) + 1 + ThreadStackPages) * PageSize;
+
+    machine->WriteRegister (StackReg, top - 16);
+    DEBUG ('a', "Initializing stack register to %d\n", top - 16);
 }
 
 // Returns how many threads the system can handle
 int AddrSpace::GetMaxNumThreads() {
-    return UserStackSize / (PageSize * 3);
+    return MaxUserThreads;
 }
 
 /*
@@ -292,9 +456,25 @@ int AddrSpace::GetAndSetFreeStackLocation () {
     return location;
 }
 
+// The pages of the stack are given back before the location can be
+// handed to another thread, which starts with a zeroed stack
 void AddrSpace::FreeStackLocation (int location) {    
     stackBitMapLock->Acquire();
     DEBUG('a', "Freeing stack location %d\n", location);
+
+    pageInLock->Acquire ();
+#ifdef VM
+    coreMap->Acquire ();
+#endif
+    unsigned int base = ThreadStackBase (location);
+    for (unsigned int vpn = base + 1; vpn <= base + ThreadStackPages; vpn++)
+        ReleasePage (vpn);
+    machine->MappingChanged ();
+#ifdef VM
+    coreMap->Release ();
+#endif
+    pageInLock->Release ();
+
     stackBitMap->Clear(location);
     stackBitMapLock->Release();
 }
@@ -393,45 +573,463 @@ int AddrSpace::getNumberOfUserThreads() {
     return numberOfUserThreads;
 }
 
-/*
-Virtual Memory
-*/
+//----------------------------------------------------------------------
+// LoadSegmentPart
+//      Copy into "frame" the part of segment "seg" of "executable"
+//      that lies in virtual page "vpn", if any.
+//----------------------------------------------------------------------
 
-static void ReadAtVirtual(OpenFile *executable, int virtualaddr, int numBytes, int position, 
-  TranslationEntry *pageTable, unsigned numPages) {
+static void
+LoadSegmentPart (OpenFile *executable, Segment *seg, unsigned int vpn,
+                 int frame)
+{
+    int start = vpn * PageSize;
+    int end = start + PageSize;
 
-    // Start by reading from the physical memory into a temporary buffer
-    char temp_buffer[numBytes];
-    int read_bytes = executable->ReadAt(temp_buffer, numBytes, position);
+    if (seg->size <= 0)
+        return;
+    if (seg->virtualAddr > start)
+        start = seg->virtualAddr;
+    if (seg->virtualAddr + seg->size < end)
+        end = seg->virtualAddr + seg->size;
+    if (start >= end)
+        return;
+    executable->ReadAt (&machine->mainMemory[frame * PageSize + start % PageSize],
+                        end - start,
+                        seg->inFileAddr + (start - seg->virtualAddr));
+}
 
-    // Since we need to write to pageTable, we need to keep a reference of the current table (entry) and size
-    TranslationEntry *old_table = machine->pageTable;
-    int old_size = machine->pageTableSize;
+//----------------------------------------------------------------------
+// AddrSpace::IsTextPage
+//      Is virtual page "vpn" made only of code?  Such a page never
+//      changes, so it can be shared by all the processes running this
+//      executable.  A page holding the end of the code and the start
+//      of the data is not.
+//----------------------------------------------------------------------
 
-    // Now change the machine to pageTable and proceed to write
-    machine->pageTable = pageTable;
-    machine->pageTableSize = numPages;
-    
-    // int physicalAddress;
-    // machine->Translate(virtualaddr, &physicalAddress, 1, FALSE);    
-    // DEBUG('l', "Start address: %d\n", physicalAddress );
-    
-    // machine->Translate(virtualaddr + read_bytes, &physicalAddress, 1, FALSE);
-    // DEBUG('l', "End address: %d\n", physicalAddress );
-    
-    // int PC = machine->ReadRegister(PCReg);
-    // machine->Translate(PC , &physicalAddress, 1, FALSE);
-    // DEBUG('l', "PC: %d\n", PC);
-    
-    for (int i = 0; i < read_bytes; i++) {
-        machine->WriteMem(virtualaddr + i, 1, temp_buffer[i]);
+bool
+AddrSpace::IsTextPage (unsigned int vpn)
+{
+    int start = vpn * PageSize;
+
+    return noffH.code.size > 0 && start >= noffH.code.virtualAddr
+        && start + PageSize <= noffH.code.virtualAddr + noffH.code.size;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::PageIn
+//      Handle the first reference to virtual page "vpn": take a zeroed
+//      frame, copy in the parts of the code and initialized data
+//      segments that fall in this page, and make it valid.  Pages of
+//      the uninitialized data and of the stack are simply left zeroed.
+//
+//      Called by ExceptionHandler on a PageFaultException, and by the
+//      kernel copy routines (usercopy.cc) when they meet a page that is
+//      not there yet.  Several threads of the address space may fault
+//      on the same page at the same time: the second one finds it valid.
+//
+//      With VM, the frame may come from another page, evicted by the
+//      CoreMap, and a page that was evicted dirty is read back from its
+//      swap slot instead.
+//
+//      Pages made only of code are shared, read-only, with the other
+//      address spaces running the same executable, through the text
+//      cache.  Pages of a mapped file are read from the file.
+//----------------------------------------------------------------------
+
+bool
+AddrSpace::PageIn (unsigned int vpn)
+{
+    if (vpn >= numPages)
+        return FALSE;
+    if (IsGuardPage (vpn)) {
+        DEBUG ('a', "Reference to the guard page %d: stack overflow\n", vpn);
+        return FALSE;
+    }
+
+    pageInLock->Acquire ();
+    if (pageTable[vpn].valid) {
+        pageInLock->Release ();
+        return TRUE;
+    }
+    MmapRegion *region = FindMapping (vpn);
+    if (vpn >= mmapStart && region == NULL) {	// nothing mapped there
+        pageInLock->Release ();
+        return FALSE;
+    }
+#ifdef VM
+    coreMap->Acquire ();	// no frame changes hands meanwhile
+#endif
+    bool text = IsTextPage (vpn);
+    int frame = -1;
+    if (text)
+        frame = textCache->Lookup (executable->fileSector (), vpn);
+    if (frame >= 0)
+        DEBUG ('a', "Page fault on page %d, shared frame %d\n", vpn, frame);
+    else {
+#ifdef VM
+        frame = coreMap->AllocateFrame (this, vpn, &pageTable[vpn]);
+#else
+        frame = frameProvider->GetEmptyFrame ();
+#endif
+        if (frame < 0) {
+#ifdef VM
+            coreMap->Release ();
+#endif
+            pageInLock->Release ();
+            return FALSE;
+        }
+        DEBUG ('a', "Page fault on page %d, loaded in frame %d\n", vpn, frame);
+#ifdef VM
+        if (swapSlot[vpn] >= 0)
+            swapFile->ReadSlot (swapSlot[vpn], &machine->mainMemory[frame * PageSize]);
+        else
+#endif
+        if (region != NULL)
+            LoadMappedPage (region, vpn, frame);
+        else
+        {
+            LoadSegmentPart (executable, &noffH.code, vpn, frame);
+            LoadSegmentPart (executable, &noffH.initData, vpn, frame);
+        }
+        if (text)
+            textCache->Insert (executable->fileSector (), vpn, frame);
+    }
+
+    pageTable[vpn].physicalPage = frame;
+    pageTable[vpn].readOnly = text;
+    pageTable[vpn].use = FALSE;
+    pageTable[vpn].dirty = FALSE;
+    pageTable[vpn].valid = TRUE;
+    machine->MappingChanged ();
+    stats->numPageFaults++;
+#ifdef VM
+    coreMap->Release ();
+#endif
+    pageInLock->Release ();
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::ReleasePages
+//      Write the mapped files back, then give back the frames, and the
+//      swap slots, of all the pages.
+//      Called by the destructor, and when the process exits: its
+//      AddrSpace object is not deleted then, since its other threads
+//      may still be on their way out.
+//----------------------------------------------------------------------
+
+void
+AddrSpace::ReleasePages ()
+{
+    pageInLock->Acquire ();
+#ifdef VM
+    coreMap->Acquire ();	// no page of ours is being evicted
+#endif
+    for (int i = 0; i < MaxMmaps; i++)
+        if (mmaps[i].file != NULL)
+            UnmapRegion (&mmaps[i]);
+    for (unsigned int i = 0; i < numPages; i++)
+        ReleasePage (i);
+    machine->MappingChanged ();
+#ifdef VM
+    coreMap->Release ();
+#endif
+    pageInLock->Release ();
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::CopyOnWrite
+//      Handle a write to page "vpn" while it is shared read-only with a
+//      duplicate: give it a private copy of the frame, unless the other
+//      users have released it meanwhile, in which case it can simply
+//      be made writable again.
+//
+//      Called by ExceptionHandler on a ReadOnlyException, and by the
+//      kernel copy routines.  Return FALSE if the page is not a
+//      copy-on-write page (a real protection error), or if memory is
+//      full.
+//----------------------------------------------------------------------
+
+bool
+AddrSpace::CopyOnWrite (unsigned int vpn)
+{
+    if (vpn >= numPages)
+        return FALSE;
+
+    pageInLock->Acquire ();
+    TranslationEntry *entry = &pageTable[vpn];
+    if (!cow[vpn]) {		// another thread got there first?
+        bool writable = entry->valid && !entry->readOnly;
+        pageInLock->Release ();
+        return writable;
+    }
+    ASSERT (entry->valid);	// shared frames are never evicted
+#ifdef VM
+    coreMap->Acquire ();
+#endif
+    machine->FlushTLB ();	// it holds a copy of "entry"
+    int shared = entry->physicalPage;
+    if (frameProvider->FrameRefCount (shared) > 1) {
+#ifdef VM
+        int frame = coreMap->AllocateFrame (this, vpn, entry);
+#else
+        int frame = frameProvider->GetEmptyFrame ();
+#endif
+        if (frame < 0) {
+#ifdef VM
+            coreMap->Release ();
+#endif
+            pageInLock->Release ();
+            return FALSE;
+        }
+        DEBUG ('a', "Copy on write of page %d, frame %d to %d\n",
+               vpn, shared, frame);
+        memcpy (&machine->mainMemory[frame * PageSize],
+                &machine->mainMemory[shared * PageSize], PageSize);
+#ifdef VM
+        coreMap->ReleaseFrame (shared);
+#else
+        frameProvider->ReleaseFrame (shared);
+#endif
+        entry->physicalPage = frame;
+        stats->numCopyOnWrites++;
+    }
+#ifdef VM
+    else
+        coreMap->AdoptFrame (shared, this, vpn, entry);
+#endif
+    cow[vpn] = FALSE;
+    entry->readOnly = FALSE;
+    entry->dirty = TRUE;
+    machine->MappingChanged ();
+#ifdef VM
+    coreMap->Release ();
+#endif
+    pageInLock->Release ();
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::ReleasePage
+//      Give back the frame and the swap slot of page "vpn", if it has
+//      any.  The caller holds the locks taken by ReleasePages, and
+//      calls MappingChanged afterwards.
+//----------------------------------------------------------------------
+
+void
+AddrSpace::ReleasePage (unsigned int vpn)
+{
+    if (pageTable[vpn].valid) {
+        pageTable[vpn].valid = FALSE;
+        cow[vpn] = FALSE;
+        if (IsTextPage (vpn))
+            textCache->Release (pageTable[vpn].physicalPage);
+        else
+#ifdef VM
+            coreMap->ReleaseFrame (pageTable[vpn].physicalPage);
+#else
+            frameProvider->ReleaseFrame (pageTable[vpn].physicalPage);
+#endif
     }
+#ifdef VM
+    if (swapSlot[vpn] >= 0) {
+        swapFile->FreeSlot (swapSlot[vpn]);
+        swapSlot[vpn] = -1;
+    }
+#endif
+}
+
+//----------------------------------------------------------------------
+// Mapped files
+//      The top MmapPages pages of the address space are a window where
+//      files are mapped.  A mapping covers whole pages; the part of its
+//      last page beyond the end of the file reads as zeros and is not
+//      written back.  Pages are read from the file on their first
+//      reference, and written back, if dirty, when the file is
+//      unmapped, when the process exits, or (VM) when evicted.
+//
+//      The region table and the window are protected by pageInLock.
+//----------------------------------------------------------------------
+
+MmapRegion *
+AddrSpace::FindMapping (unsigned int vpn)
+{
+    if (vpn < mmapStart)
+        return NULL;
+    for (int i = 0; i < MaxMmaps; i++)
+        if (mmaps[i].file != NULL && vpn >= mmaps[i].firstPage
+            && vpn < mmaps[i].firstPage + mmaps[i].numPages)
+            return &mmaps[i];
+    return NULL;
+}
+
+void
+AddrSpace::LoadMappedPage (MmapRegion *region, unsigned int vpn, int frame)
+{
+    int offset = (vpn - region->firstPage) * PageSize;
+    int size = region->length - offset;
+
+    if (size > PageSize)
+        size = PageSize;
+    region->file->ReadAt (&machine->mainMemory[frame * PageSize], size, offset);
+}
+
+void
+AddrSpace::WriteMappedPage (MmapRegion *region, unsigned int vpn)
+{
+    int offset = (vpn - region->firstPage) * PageSize;
+    int size = region->length - offset;
+
+    if (size > PageSize)
+        size = PageSize;
+    DEBUG ('a', "Writing back mapped page %d\n", vpn);
+    region->file->WriteAt (&machine->mainMemory[pageTable[vpn].physicalPage * PageSize],
+                           size, offset);
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::Mmap
+//      Map the first "length" bytes of "file" (at most its size) into
+//      the window.  The mapping has its own OpenFile, so it survives
+//      closing "file".  Return the user address of the mapping, or -1.
+//----------------------------------------------------------------------
+
+int
+AddrSpace::Mmap (OpenFile *file, int length)
+{
+    int slot, first = -1;
+
+    if (length > file->Length ())
+        length = file->Length ();
+    if (length <= 0)
+        return -1;
+    int pages = divRoundUp (length, PageSize);
+
+    pageInLock->Acquire ();
+    for (slot = 0; slot < MaxMmaps && mmaps[slot].file != NULL; slot++)
+        continue;
+    // first fit in the window
+    for (int start = 0; slot < MaxMmaps && start + pages <= MmapPages; start++) {
+        int n = 0;
+        while (n < pages && !mmapMap->Test (start + n))
+            n++;
+        if (n == pages) {
+            first = start;
+            break;
+        }
+        start += n;
+    }
+    if (first < 0 || opentable->PushOpenFile (file->fileSector ()) == -1) {
+        pageInLock->Release ();
+        return -1;
+    }
+    for (int i = 0; i < pages; i++)
+        mmapMap->Mark (first + i);
+    mmaps[slot].file = new OpenFile (file->fileSector ());
+    mmaps[slot].firstPage = mmapStart + first;
+    mmaps[slot].numPages = pages;
+    mmaps[slot].length = length;
+    pageInLock->Release ();
+
+    DEBUG ('a', "Mapped %d bytes of file %d at page %d\n", length,
+           file->fileSector (), mmapStart + first);
+    return (mmapStart + first) * PageSize;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::Munmap
+//      Remove the mapping starting at user address "addr".  Return
+//      FALSE if there is none.
+//----------------------------------------------------------------------
+
+bool
+AddrSpace::Munmap (int addr)
+{
+    if (addr < 0 || addr % PageSize != 0)
+        return FALSE;
+    pageInLock->Acquire ();
+    MmapRegion *region = FindMapping ((unsigned) addr / PageSize);
+    if (region == NULL || region->firstPage != (unsigned) addr / PageSize) {
+        pageInLock->Release ();
+        return FALSE;
+    }
+#ifdef VM
+    coreMap->Acquire ();
+#endif
+    UnmapRegion (region);
+    machine->MappingChanged ();
+#ifdef VM
+    coreMap->Release ();
+#endif
+    pageInLock->Release ();
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::UnmapRegion
+//      Write back the dirty pages of "region", free its pages, and
+//      close its file.  The caller holds the locks of ReleasePages.
+//----------------------------------------------------------------------
 
-    // Go back
-    machine->pageTable = old_table;
-    machine->pageTableSize = old_size;
+void
+AddrSpace::UnmapRegion (MmapRegion *region)
+{
+    machine->FlushTLB ();	// it may hold the latest dirty bits
+    for (unsigned int vpn = region->firstPage;
+         vpn < region->firstPage + region->numPages; vpn++) {
+        if (pageTable[vpn].valid && pageTable[vpn].dirty)
+            WriteMappedPage (region, vpn);
+        ReleasePage (vpn);
+        mmapMap->Clear (vpn - mmapStart);
+    }
+    opentable->PullOpenFile (region->file->fileSector ());
+    delete region->file;
+    region->file = NULL;
 }
 
+#ifdef VM
+//----------------------------------------------------------------------
+// AddrSpace::PageOut
+//      Called by the CoreMap, with its lock held, to take back the
+//      frame of page "vpn".  The page is invalidated first, so that no
+//      thread of this space can touch it while it is written out; it is
+//      written to swap only if it was modified since it was loaded.  A
+//      clean page is either still in its swap slot, or can be read
+//      again from the executable (or zero-filled).
+//----------------------------------------------------------------------
+
+void
+AddrSpace::PageOut (unsigned int vpn)
+{
+    TranslationEntry *entry = &pageTable[vpn];
+
+    ASSERT (entry->valid);
+    entry->valid = FALSE;
+    machine->MappingChanged ();
+    if (IsTextPage (vpn))
+        textCache->Forget (entry->physicalPage);
+    MmapRegion *region = FindMapping (vpn);
+    if (region != NULL) {		// backed by its file, not by swap
+        if (entry->dirty)
+            WriteMappedPage (region, vpn);
+        entry->dirty = FALSE;
+        return;
+    }
+    if (entry->dirty) {
+        if (swapSlot[vpn] < 0)
+            swapSlot[vpn] = swapFile->AllocSlot ();
+        if (swapSlot[vpn] < 0) {
+            printf ("Out of swap space\n");
+            ASSERT (FALSE);
+        }
+        swapFile->WriteSlot (swapSlot[vpn],
+                             &machine->mainMemory[entry->physicalPage * PageSize]);
+        entry->dirty = FALSE;
+    }
+}
+#endif
+
 void AddrSpace::setExtraArg(char *newArg) {
     hasArg = true;
     
@@ -20,7 +20,22 @@
 #ifdef CHANGED
 #include "synch.h"
 #include "list.h"
+#include "noff.h"
 #define MAX_FILES 5
+#define MaxUserThreads		256	// thread stacks in an address space
+#define ThreadStackPages	8	// pages of each of them, not
+					// counting its guard page
+#define MmapPages		512	// size of the window for mapped files
+#define MaxMmaps		8	// files mapped at the same time
+
+// A file mapped in the address space
+class MmapRegion {
+  public:
+    OpenFile *file;		// the file, or NULL if the entry is free
+    unsigned int firstPage;	// where it is mapped
+    unsigned int numPages;
+    int length;			// bytes of the file mapped
+};
 #endif
 
 #define UserStackSize		2048	// increase this as necessary!
@@ -33,6 +48,10 @@ class AddrSpace
     AddrSpace (OpenFile * executable);	// Create an address space,
     // initializing it with the program
     // stored in the file "executable"
+#ifdef CHANGED
+    AddrSpace (AddrSpace * parent);	// Create a copy-on-write
+    // duplicate of the running space
+#endif
     ~AddrSpace ();		// De-allocate an address space
 
     void InitRegisters ();	// Initialize user-level CPU registers,
@@ -40,8 +59,12 @@ class AddrSpace
 
     void SaveState ();		// Save/restore address space-specific
     void RestoreState ();	// info on a context switch 
-    
-    void MultiThreadSetStackPointer(unsigned int newPositionOffset);
+
+#ifdef CHANGED
+    void SetThreadStackPointer(int location);
+				// Point the stack register at the top of
+				// the stack of thread "location"
+#endif
 
     // Returns how many threads the system can handle
     int GetMaxNumThreads ();
@@ -70,6 +93,28 @@ class AddrSpace
     
     void setExtraArg(char *newArg);
     char* getExtraArg();
+
+    bool PageIn(unsigned int vpn);
+				// Give virtual page "vpn" a frame, and
+				// fill it from the executable (or with
+				// zeros).  Return FALSE if "vpn" is
+				// outside the address space or memory
+				// is full
+    void ReleasePages();	// Free the memory of all the pages
+    int Mmap(OpenFile *file, int length);
+				// Map "file" in the address space, and
+				// return its address, or -1
+    bool Munmap(int addr);	// Unmap the file mapped at "addr"
+    bool CopyOnWrite(unsigned int vpn);
+				// Make page "vpn" writable, copying it
+				// if it is still shared.  Return FALSE
+				// if it is really read-only
+#ifdef VM
+    void PageOut(unsigned int vpn);
+				// Take the frame of page "vpn" back,
+				// saving the page to swap if needed
+				// (called by the CoreMap)
+#endif
     
 #endif   // END CHANGED
   private:
@@ -79,6 +124,32 @@ class AddrSpace
     // address space
 
 #ifdef CHANGED
+    OpenFile *executable;	// kept open to load pages on demand
+    NoffHeader noffH;		// where the segments are, in it
+    Lock *pageInLock;		// serializes PageIn
+    bool *cow;			// is each page shared copy-on-write?
+    void InitProcessState();	// common part of the constructors
+    bool IsTextPage(unsigned int vpn);
+				// shared through the text cache?
+    unsigned int threadStacksStart;
+				// first page of the thread stacks
+    unsigned int ThreadStackBase(int location);
+				// guard page of thread stack "location"
+    bool IsGuardPage(unsigned int vpn);
+    void ReleasePage(unsigned int vpn);
+				// free the frame and swap slot of "vpn"
+
+    unsigned int mmapStart;	// first page of the mapped files window
+    BitMap *mmapMap;		// pages of the window in use
+    MmapRegion mmaps[MaxMmaps];
+    MmapRegion *FindMapping(unsigned int vpn);
+    void LoadMappedPage(MmapRegion *region, unsigned int vpn, int frame);
+    void WriteMappedPage(MmapRegion *region, unsigned int vpn);
+    void UnmapRegion(MmapRegion *region);
+#ifdef VM
+    int *swapSlot;		// swap slot holding each page, or -1
+#endif
+
     int numberOfUserThreads;
     
     // Available pages
@@ -19,11 +19,17 @@
 
 BitMap::BitMap (int nitems)
 {
+#ifdef CHANGED
+    pending = NULL;
+#endif
     numBits = nitems;
     numWords = divRoundUp (numBits, BitsInWord);
     map = new unsigned int[numWords];
     for (int i = 0; i < numBits; i++)
 	Clear (i);
+#ifdef CHANGED
+    MarkClean ();
+#endif
 }
 
 //----------------------------------------------------------------------
@@ -51,6 +57,12 @@ BitMap::Mark (int which)
 {
     ASSERT (which >= 0 && which < numBits);
     map[which / BitsInWord] |= 1 << (which % BitsInWord);
+#ifdef CHANGED
+    if (which / BitsInWord < firstDirty)
+	firstDirty = which / BitsInWord;
+    if (which / BitsInWord > lastDirty)
+	lastDirty = which / BitsInWord;
+#endif
 }
 
 //----------------------------------------------------------------------
@@ -64,7 +76,18 @@ void
 BitMap::Clear (int which)
 {
     ASSERT (which >= 0 && which < numBits);
+#ifdef CHANGED
+    if (pending != NULL)	// cleared later, by the owner, but
+	pending->Mark (which);	// written back cleared already
+    else
+#endif
     map[which / BitsInWord] &= ~(1 << (which % BitsInWord));
+#ifdef CHANGED
+    if (which / BitsInWord < firstDirty)
+	firstDirty = which / BitsInWord;
+    if (which / BitsInWord > lastDirty)
+	lastDirty = which / BitsInWord;
+#endif
 }
 
 //----------------------------------------------------------------------
@@ -106,6 +129,46 @@ BitMap::Find ()
     return -1;
 }
 
+#ifdef CHANGED
+//----------------------------------------------------------------------
+// BitMap::FindFrom
+//      Same as Find, but look for the first clear bit at or after
+//      "start", then before it: allocate close to "start" if possible.
+//----------------------------------------------------------------------
+
+int
+BitMap::FindFrom (int start)
+{
+    if (start < 0 || start >= numBits)
+	start = 0;
+    for (int n = 0, i = start; n < numBits; n++, i = (i + 1) % numBits)
+	if (!Test (i))
+	  {
+	      Mark (i);
+	      return i;
+	  }
+    return -1;
+}
+
+//----------------------------------------------------------------------
+// BitMap::NumClearIn
+//      Return the number of clear bits among the "count" bits starting
+//      at bit "first".
+//----------------------------------------------------------------------
+
+int
+BitMap::NumClearIn (int first, int count)
+{
+    int clear = 0;
+
+    ASSERT (first >= 0 && first + count <= numBits);
+    for (int i = first; i < first + count; i++)
+	if (!Test (i))
+	    clear++;
+    return clear;
+}
+#endif
+
 //----------------------------------------------------------------------
 // BitMap::NumClear
 //      Return the number of clear bits in the bitmap.
@@ -154,6 +217,9 @@ void
 BitMap::FetchFrom (OpenFile * file)
 {
     file->ReadAt ((char *) map, numWords * sizeof (unsigned), 0);
+#ifdef CHANGED
+    MarkClean ();
+#endif
 }
 
 //----------------------------------------------------------------------
@@ -167,4 +233,92 @@ void
 BitMap::WriteBack (OpenFile * file)
 {
     file->WriteAt ((char *) map, numWords * sizeof (unsigned), 0);
+#ifdef CHANGED
+    MarkClean ();
+#endif
+}
+
+#ifdef CHANGED
+//----------------------------------------------------------------------
+// BitMap::IsDirty
+//      Return TRUE if a bit was set or cleared since the bitmap was
+//      last fetched from or written back to its file.
+//----------------------------------------------------------------------
+
+bool
+BitMap::IsDirty ()
+{
+    return firstDirty <= lastDirty;
+}
+
+//----------------------------------------------------------------------
+// BitMap::WriteBackDirty
+//      Like WriteBack, but only write the words that changed since the
+//      bitmap was last fetched or written back: a few bytes, usually,
+//      instead of the whole map.  Bits whose clear is deferred are
+//      written cleared.
+//
+//      "file" is the place to write the bitmap to
+//----------------------------------------------------------------------
+
+void
+BitMap::WriteBackDirty (OpenFile * file)
+{
+    int numDirty = lastDirty - firstDirty + 1;
+    unsigned int *words;
+
+    if (!IsDirty ())
+	return;
+    words = new unsigned int[numDirty];
+    for (int i = 0; i < numDirty; i++) {
+	words[i] = map[firstDirty + i];
+	if (pending != NULL)
+	    words[i] &= ~pending->map[firstDirty + i];
+    }
+    file->WriteAt ((char *) words, numDirty * sizeof (unsigned),
+		   firstDirty * sizeof (unsigned));
+    delete [] words;
+    MarkClean ();
+}
+
+//----------------------------------------------------------------------
+// BitMap::DeferClears
+//      From now on, Clear leaves the bits set, and sets them in
+//      "pendingClears" instead, until DeferClears (NULL) is called.  The
+//      owner of the bitmap clears them later, when it is safe to
+//      allocate them again.  WriteBackDirty writes them cleared at once.
+//
+//      "pendingClears" is the bitmap recording the deferred clears
+//----------------------------------------------------------------------
+
+void
+BitMap::DeferClears (BitMap * pendingClears)
+{
+    pending = pendingClears;
+}
+
+//----------------------------------------------------------------------
+// BitMap::Unmark
+//      Clear the "nth" bit at once, whether clears are deferred or not.
+//      For a bit just set by the caller, which nothing has seen yet.
+//
+//      "which" is the number of the bit to be cleared.
+//----------------------------------------------------------------------
+
+void
+BitMap::Unmark (int which)
+{
+    BitMap *deferred = pending;
+
+    pending = NULL;
+    Clear (which);
+    pending = deferred;
+}
+
+void
+BitMap::MarkClean ()
+{
+    firstDirty = numWords;
+    lastDirty = -1;
 }
+#endif
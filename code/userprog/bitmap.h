@@ -45,6 +45,13 @@ class BitMap
     // effect, set the bit. 
     // If no bits are clear, return -1.
     int NumClear ();		// Return the number of clear bits
+#ifdef CHANGED
+    int FindFrom (int start);	// Same as Find, but the first clear bit
+    // from "start" on, wrapping around
+    int NumClearIn (int first, int count);
+				// Number of clear bits among "count"
+				// bits from "first" on
+#endif
 
     void Print ();		// Print contents of bitmap
 
@@ -52,6 +59,19 @@ class BitMap
     // write the bitmap to a file
     void FetchFrom (OpenFile * file);	// fetch contents from disk 
     void WriteBack (OpenFile * file);	// write contents to disk
+#ifdef CHANGED
+    bool IsDirty ();		// Changed since the last fetch or write back?
+    void WriteBackDirty (OpenFile * file);
+				// Write only the words changed since
+				// then, the deferred clears done
+    void DeferClears (BitMap * pendingClears);
+				// Record the bits cleared in
+				// "pendingClears" instead, or clear
+				// them again if NULL
+    void Unmark (int which);	// Clear the "nth" bit now, even if clears
+				// are deferred: undo a Mark that was
+				// never written back
+#endif
 
   private:
     int numBits;		// number of bits in the bitmap
@@ -60,6 +80,13 @@ class BitMap
     //  multiple of the number of bits in
     //  a word)
     unsigned int *map;		// bit storage
+#ifdef CHANGED
+    int firstDirty, lastDirty;	// range of words changed since the last
+				// fetch or write back (empty if
+				// firstDirty > lastDirty)
+    BitMap *pending;		// where Clear records the bits, or NULL
+    void MarkClean ();
+#endif
 };
 
 #endif // BITMAP_H
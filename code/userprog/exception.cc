@@ -41,6 +41,7 @@
 #include "filehdr.h"
 #include "openfile.h"
 #include "userprocess.h"
+#include "usercopy.h"
 #endif
 
 //----------------------------------------------------------------------
@@ -58,70 +59,6 @@ UpdatePC ()
     machine->WriteRegister (NextPCReg, pc);
 }
 
-#ifdef CHANGED
-
-//------------------------------------------------------------
-// copyStringFromMachine
-//
-// Copies a string from the MIPS mode to the Linux mode.
-//   from: the address of the string
-//   to: the buffer
-//   size: the number of character to read from the address
-//------------------------------------------------------------
-unsigned int copyStringFromMachine(int from, char *to, unsigned size) {
-    
-    bool stop = false;
-    int iteration = 0;
-    unsigned int bytesRead = 0;
-    int buffer;
-    
-    //Must read from an address divisible by 4
-    int fromPosition = from;
-    if (from % 4 != 0 )
-        fromPosition = from - (from % 4);
-    
-    do {
-        machine -> ReadMem(fromPosition + iteration * 4, 4, &buffer);
-        unsigned char* charArray = (unsigned char*) &buffer;
-
-        //check condition to stop
-        for (int i = 0; i < 4; i ++) {
-        
-            //Skip some of the first element due to alignment issue :D
-            if (iteration == 0 && fromPosition + i < from)
-                continue;
-        
-            if (charArray[i] == '\0') {
-                stop = true;
-                break;
-            }
-            
-            if (bytesRead < size) {
-                to[bytesRead] = charArray [i];
-                bytesRead ++;
-            }
-            else {
-                stop = true;
-                break;
-            }
-            
-        }
-        iteration++;
-                
-    } while (!stop);   
-    
-    if (bytesRead == size) {
-        //WARNING: Replace the last character with \0
-        to[size - 1] = '\0';
-        bytesRead --;
-    }
-    else 
-        to[bytesRead] = '\0';
-    
-    return bytesRead;
-}
-#endif
-
 //----------------------------------------------------------------------
 // ExceptionHandler
 //      Entry point into the Nachos kernel.  Called when a user program
@@ -178,7 +115,7 @@ ExceptionHandler (ExceptionType which)
               DEBUG('a', "Create, initiated by user program.\n");
               int res,rg4 = machine->ReadRegister (4);
               char buffer[FileNameMaxLen] = {};
-              copyStringFromMachine(rg4,buffer,FileNameMaxLen);
+              StrnCopyFromUser(rg4,buffer,FileNameMaxLen);
               fileSystem->Create(buffer) ? res = 0 : res = -1;
               machine->WriteRegister (2, res);
               break;
@@ -189,7 +126,7 @@ ExceptionHandler (ExceptionType which)
               OpenFile *temp = NULL;
               int res = -1, rg4 = machine->ReadRegister (4);
               char buffer[FileNameMaxLen] = {};
-              copyStringFromMachine(rg4,buffer,FileNameMaxLen);
+              StrnCopyFromUser(rg4,buffer,FileNameMaxLen);
               if ((temp = fileSystem->Open(buffer)) != NULL && opentable->PushOpenFile(temp->fileSector()) != -1)
                    res = currentThread->space->PushTable(temp);
               machine->WriteRegister (2, res);
@@ -215,15 +152,17 @@ ExceptionHandler (ExceptionType which)
               int rg4 = machine->ReadRegister (4);
               int rg5 = machine->ReadRegister (5);
               int rg6 = machine->ReadRegister (6);
-              char *buffer = NULL,ch;
-              buffer = &machine->mainMemory[rg4];
+              char buffer[MAX_STRING_SIZE];
               OpenFile *file = currentThread->space->OpenSearch(rg6);
-              int res = file->Read(buffer,rg5);
-              for (int i=0;i<rg5;i++) {
-                ch = buffer[i];
-                if (ch == EOF) break;
-                else 
-                   machine->WriteMem(rg4+i,1,ch);
+              int res = 0, size;
+              // read through a kernel buffer, one chunk at a time
+              while (res < rg5) {
+                size = rg5 - res < MAX_STRING_SIZE ? rg5 - res : MAX_STRING_SIZE;
+                size = file->Read(buffer, size);
+                if (size <= 0)
+                   break;
+                CopyToUser(buffer, rg4 + res, size);
+                res += size;
               }
               machine->WriteRegister (2, res);
               break;
@@ -234,28 +173,20 @@ ExceptionHandler (ExceptionType which)
               int rg4 = machine->ReadRegister (4);
               int rg5 = machine->ReadRegister (5);
               int rg6 = machine->ReadRegister (6);
-              int res = 0,size = 0,round = 0;
+              int res = 0,size = 0;
               OpenFile *file = currentThread->space->OpenSearch(rg6);
-              char buffer[MAX_STRING_SIZE] = {};
-              bool status = false;
-              do {
-               if(rg5 >= MAX_STRING_SIZE)
-                  if((size = copyStringFromMachine(rg4+MAX_STRING_SIZE*round,buffer,rg5)) == MAX_STRING_SIZE) {
-                      res = res + file->Write(buffer,MAX_STRING_SIZE);
-                      rg5 = rg5 - MAX_STRING_SIZE;
-                      round++;
-                  }
-                  else {
-                      status = true;
-                      if(size != 0)
-                         res = res + file->Write(buffer,rg5);
-                  }
-               else {
-                  status = true;
-                  copyStringFromMachine(rg4+MAX_STRING_SIZE*round,buffer,rg5);
-                  res = res + file->Write(buffer,rg5);
-               }
-              } while(status == false);
+              char buffer[MAX_STRING_SIZE];
+              // write through a kernel buffer, one chunk at a time
+              while (res < rg5) {
+                size = rg5 - res < MAX_STRING_SIZE ? rg5 - res : MAX_STRING_SIZE;
+                size = CopyFromUser(rg4 + res, buffer, size);
+                if (size <= 0)
+                   break;
+                size = file->Write(buffer, size);
+                if (size <= 0)
+                   break;
+                res += size;
+              }
               machine->WriteRegister (2, res);
               break;
             }
@@ -276,7 +207,7 @@ ExceptionHandler (ExceptionType which)
                 char buffer[MAX_STRING_SIZE] = {};
                 int iteration = 0;
                 do {
-                    unsigned int bytesRead = copyStringFromMachine(
+                    unsigned int bytesRead = StrnCopyFromUser(
                                                     startPosition + (MAX_STRING_SIZE-1) * iteration,
                                                     buffer, MAX_STRING_SIZE);
 
@@ -335,14 +266,16 @@ ExceptionHandler (ExceptionType which)
                 int phy_addr = machine->ReadRegister(4);
                 int size = machine->ReadRegister(5);
 
-                // Get char by char so that we can find the end of file.
+                // Get char by char so that we can find the end of file,
+                // then hand the whole string to the user at once.
                 int i, ch;
+                char *buffer = new char[size > 1 ? size : 1];
                 for (i = 0; i < size - 1; i++) {
                     ch = synchconsole->SynchGetChar();
                     if (ch == EOF) {
                         break;
                     } else {
-                        machine->WriteMem(phy_addr + i, 1, ch);
+                        buffer[i] = ch;
                         if (ch == '\n' || ch == '\0') {
                             break;
                         }
@@ -350,7 +283,9 @@ ExceptionHandler (ExceptionType which)
                 }
 
                 // End the String at the end
-                machine->WriteMem(phy_addr + i, 1, '\0');
+                buffer[i] = '\0';
+                CopyToUser(buffer, phy_addr, i + 1);
+                delete [] buffer;
                 break;
             }
             case SC_GetStringCommand:
@@ -358,14 +293,16 @@ ExceptionHandler (ExceptionType which)
                 int phy_addr = machine->ReadRegister(4);
                 int size = machine->ReadRegister(5);
 
-                // Get char by char so that we can find the end of file.
+                // Get char by char so that we can find the end of file,
+                // then hand the whole string to the user at once.
                 int i, ch;
+                char *buffer = new char[size > 1 ? size : 1];
                 for (i = 0; i < size - 1; i++) {
                     ch = synchconsole->SynchGetChar();
                     if (ch == EOF) {
                         break;
                     } else {
-                        machine->WriteMem(phy_addr + i, 1, ch);
+                        buffer[i] = ch;
                         if (ch == '\n' || ch == '\0') {
                             break;
                         }
@@ -373,7 +310,9 @@ ExceptionHandler (ExceptionType which)
                 }
 
                 // End the String at the end
-                machine->WriteMem(phy_addr + i, 1, '\0');
+                buffer[i] = '\0';
+                CopyToUser(buffer, phy_addr, i + 1);
+                delete [] buffer;
                 break;
             }
             case SC_PutInt:
@@ -391,14 +330,14 @@ ExceptionHandler (ExceptionType which)
             }
             case SC_GetInt:
             {
-                int val = synchconsole->SynchGetInt();
-                machine->WriteMem(machine->ReadRegister(4), 4, val);
+                int val = WordToMachine(synchconsole->SynchGetInt());
+                CopyToUser((char *) &val, machine->ReadRegister(4), 4);
                 break;
             }
             case SC_GetIntCommand:
             {
-                int val = synchconsole->SynchGetInt();
-                machine->WriteMem(machine->ReadRegister(4), 4, val);
+                int val = WordToMachine(synchconsole->SynchGetInt());
+                CopyToUser((char *) &val, machine->ReadRegister(4), 4);
                 break;
             }
             case SC_ForkExec:
@@ -407,13 +346,13 @@ ExceptionHandler (ExceptionType which)
                 int s2 = machine->ReadRegister(5);
                 
                 char cmd[30] = {};
-                copyStringFromMachine(s, cmd, 30);
+                StrnCopyFromUser(s, cmd, 30);
                 // printf("New file name: %s\n", cmd);
 
                 char arg[30] = {};  //could be overrided here :(
                 
                 if (s2 != 0) {
-                    copyStringFromMachine(s2, arg, 30);
+                    StrnCopyFromUser(s2, arg, 30);
                     //printf("\nNew Argument: %s \n ", arg);
                     machine->WriteRegister(2, do_UserProcessCreate(cmd, arg));
                 } else {
@@ -424,6 +363,29 @@ ExceptionHandler (ExceptionType which)
                 break;
             }
             
+            case SC_ForkProcess:
+            {
+                machine->WriteRegister(2, do_UserProcessFork());
+                break;
+            }
+
+            case SC_Mmap:
+            {
+                int res = -1;
+                OpenFile *file = currentThread->space->OpenSearch(machine->ReadRegister(4));
+                if (file != NULL)
+                    res = currentThread->space->Mmap(file, machine->ReadRegister(5));
+                machine->WriteRegister(2, res);
+                break;
+            }
+
+            case SC_Munmap:
+            {
+                bool done = currentThread->space->Munmap(machine->ReadRegister(4));
+                machine->WriteRegister(2, done ? 0 : -1);
+                break;
+            }
+
             case SC_JoinExec:
             {
                 int pid = machine->ReadRegister(4);                                                
@@ -475,6 +437,35 @@ ExceptionHandler (ExceptionType which)
            }
            UpdatePC();
         }
+        else if (which == PageFaultException) {
+           // First reference to a page (load it), or TLB miss (load
+           // the translation from the page table).  Either way, the
+           // faulting instruction is then restarted.
+           unsigned int vpn =
+               (unsigned) machine->ReadRegister(BadVAddrReg) / PageSize;
+           if (!currentThread->space->PageIn(vpn)) {
+               printf("Unexpected user mode exception %d %d\n", which, type);
+               ASSERT(FALSE);
+           }
+           if (machine->tlb != NULL) {
+               machine->LoadTLB(&machine->pageTable[vpn]);
+               stats->numTLBRefills++;
+           }
+        }
+        else if (which == ReadOnlyException) {
+           // Write to a page shared with a duplicate of this address
+           // space: copy it, then restart the instruction.
+           unsigned int vpn =
+               (unsigned) machine->ReadRegister(BadVAddrReg) / PageSize;
+           if (!currentThread->space->CopyOnWrite(vpn)) {
+               printf("Unexpected user mode exception %d %d\n", which, type);
+               ASSERT(FALSE);
+           }
+           if (machine->tlb != NULL) {
+               machine->LoadTLB(&machine->pageTable[vpn]);
+               stats->numTLBRefills++;
+           }
+        }
      #endif // CHANGED
 }
 
@@ -1,37 +1,138 @@
 #ifdef CHANGED
 
 #include "system.h"
+#include "userthread.h"
 
 
 FrameProvider::FrameProvider(int numFrames) {
-  framesBitMap = new BitMap(numFrames);
-  framesBitMap->Mark(0);
+  zeroedFrames = new int[numFrames];
+  dirtyFrames = new int[numFrames];
+  refCount = new int[numFrames];
+  numZeroed = numDirty = 0;
+  // frame 0 is never handed out; the others are free and, since memory
+  // was cleared by the Machine, already zeroed
+  refCount[0] = 1;
+  for (int i = numFrames - 1; i > 0; i--) {
+    refCount[i] = 0;
+    zeroedFrames[numZeroed++] = i;
+  }
   lock = new Lock("FrameProvider lock");
+  dirtyAvail = new Semaphore("dirty frames", 0);
+  cpuIdle = new Semaphore("cpu idle", 0);
+  zeroerWaiting = false;
 }
 
 FrameProvider::~FrameProvider() {
-  delete(framesBitMap);
+  delete [] zeroedFrames;
+  delete [] dirtyFrames;
+  delete [] refCount;
 }
 
+// Take a zeroed frame if there is one; clear a dirty one otherwise.
+// Frames are taken from the top of the stacks, so that the ones freed
+// last, still in the host cache, are reused first.
 int FrameProvider::GetEmptyFrame() {
-  // TODO Random()
+  int frame;
+
   lock->Acquire();
-  int frame = framesBitMap->Find();
-  bzero(&(machine->mainMemory[frame * PageSize]), PageSize);
+  if (numZeroed > 0) {
+    frame = zeroedFrames[--numZeroed];
+    stats->numZeroedFrameHits++;
+  } else if (numDirty > 0) {
+    frame = dirtyFrames[--numDirty];
+    stats->numZeroedFrameMisses++;
+    bzero(&(machine->mainMemory[frame * PageSize]), PageSize);
+    machine->InvalidateDecodedPage(frame);
+  } else {			// no more memory
+    lock->Release();
+    return -1;
+  }
+  refCount[frame] = 1;
   lock->Release();
   return frame;
 }
 
+// The frame only becomes free when its last user releases it
 void FrameProvider::ReleaseFrame(int frame) {
-  framesBitMap->Clear(frame);
+  lock->Acquire();
+  ASSERT(refCount[frame] > 0);
+  if (--refCount[frame] == 0) {
+    dirtyFrames[numDirty++] = frame;
+    dirtyAvail->V();
+  }
+  lock->Release();
+}
+
+void FrameProvider::ShareFrame(int frame) {
+  lock->Acquire();
+  ASSERT(refCount[frame] > 0);
+  refCount[frame]++;
+  lock->Release();
+}
+
+int FrameProvider::FrameRefCount(int frame) {
+  lock->Acquire();
+  int count = refCount[frame];
+  lock->Release();
+  return count;
 }
 
 int FrameProvider::NumAvailFrame() {
   lock->Acquire();
-  int number = framesBitMap->NumClear();
+  int number = numZeroed + numDirty;
   lock->Release();
   return number;
 }
 
+static void ZeroFramesThread(int dummy) {
+  frameProvider->ZeroFrames();
+}
+
+void FrameProvider::StartZeroing() {
+  // Thread::Fork expects a ThreadParam; there is no address space
+  ThreadParam *threadParam = new ThreadParam();
+  threadParam->isProcess = true;
+
+  Thread *zeroer = new Thread("frame zeroer");
+  zeroer->Fork(ZeroFramesThread, (int) threadParam);
+}
+
+// Clear the dirty frames one at a time, only when nobody else wants the
+// CPU: if another thread is ready, wait until CpuIdle finds none.  A
+// frame taken by GetEmptyFrame meanwhile is simply not there any more:
+// the semaphore may count more frames than the stack holds.
+void FrameProvider::ZeroFrames() {
+  for (;;) {
+    dirtyAvail->P();
+    IntStatus oldLevel = interrupt->SetLevel(IntOff);
+    if (!scheduler->IsRunningQueueEmpty()) {
+      zeroerWaiting = true;
+      cpuIdle->P();
+    }
+    (void) interrupt->SetLevel(oldLevel);
+
+    lock->Acquire();
+    if (numDirty == 0) {
+      lock->Release();
+      continue;
+    }
+    int frame = dirtyFrames[--numDirty];
+    bzero(&(machine->mainMemory[frame * PageSize]), PageSize);
+    machine->InvalidateDecodedPage(frame);
+    zeroedFrames[numZeroed++] = frame;
+    lock->Release();
+  }
+}
+
+// The ready list is empty and the CPU would idle: let the zeroing thread
+// run instead, if it is waiting for that.  It never is when it calls
+// Thread::Sleep itself: it only waits with another thread ready.
+bool FrameProvider::CpuIdle() {
+  if (!zeroerWaiting)
+    return false;
+  zeroerWaiting = false;
+  cpuIdle->V();
+  return true;
+}
 
-#endif
\ No newline at end of file
+#endif
@@ -3,9 +3,16 @@
 /*
 * Management of frames.
 * This class encapsulates the allocation of physical pages to virtual pages.
+* A frame may be mapped by several address spaces at once (copy-on-write
+* duplicates); it counts its users and is only freed by the last one.
+*
+* Free frames are kept on two stacks: frames already zeroed, and frames
+* released since their last use.  A kernel thread moves frames from the
+* second stack to the first one when no other thread is ready to run, so
+* that a page fault seldom has to clear its frame.  It blocks until then:
+* Thread::Sleep calls CpuIdle when it finds the ready list empty.
 */
 
-#include "bitmap.h"
 #include "synch.h"
 
 class FrameProvider {
@@ -15,12 +22,30 @@ class FrameProvider {
     ~FrameProvider();
 
     int GetEmptyFrame();
-    void ReleaseFrame(int frame);
+    void ReleaseFrame(int frame);	// drop one reference to "frame"
     int NumAvailFrame();
 
+    void ShareFrame(int frame);		// one more user for "frame"
+    int FrameRefCount(int frame);	// how many users "frame" has
+
+    void StartZeroing();		// Fork the thread clearing the
+					// released frames
+    void ZeroFrames();			// Body of that thread
+    bool CpuIdle();			// No thread is ready: wake that
+					// thread up if it waits for it.
+					// Called with interrupts off
+
   private:
-    BitMap *framesBitMap;
+    int *zeroedFrames;			// free frames, already zeroed
+    int numZeroed;
+    int *dirtyFrames;			// free frames, still to be zeroed
+    int numDirty;
+    int *refCount;			// users of each frame
     Lock *lock;  
+    Semaphore *dirtyAvail;		// counts the frames put on the
+					// dirty stack
+    Semaphore *cpuIdle;			// the zeroing thread waits on it
+    bool zeroerWaiting;			// until CpuIdle is called
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -39,7 +39,9 @@ StartProcess (char *filename)
   space = new AddrSpace (executable);
   currentThread->space = space;
 
+#ifndef CHANGED
   delete executable;		// close file
+#endif				// else the space loads pages from it
 
   space->InitRegisters ();	// set the initial register values
   space->RestoreState ();	// load page table register
@@ -53,6 +53,9 @@
 #define SC_PutIntCommand           29
 #define SC_GetIntCommand           30
 #define SC_DeleteDirectory        31
+#define SC_ForkProcess      32
+#define SC_Mmap             33
+#define SC_Munmap           34
 
 
 #endif  // End If CHANGED
@@ -180,6 +183,23 @@ int UserThreadJoin(int tid);
 // Process creation
 int ForkExec(char* cmd, char *arg);
 int JoinExec(int tid);  // wait for the process to finish
+
+/* Create a new process, running a copy of the address space of the
+ * calling process (shared copy-on-write).  Returns 0 in the child, and
+ * the PID of the child in the parent.  The caller should be the main
+ * thread: the other threads are not duplicated.
+ */
+int ForkProcess();
+
+/* Map the first "length" bytes of the open file "id" (at most its
+ * size) into the address space, and return their address, or -1.
+ * Pages are read from the file when first touched; the modified ones
+ * are written back by Munmap, or when the process exits.
+ */
+int Mmap (OpenFileId id, int length);
+
+/* Remove the mapping at "addr", returned by Mmap.  -1 failure, 0 success */
+int Munmap (int addr);
 int ListDirectory () ;
 int  MakeDir ();
 int ChangeDir ();
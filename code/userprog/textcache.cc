@@ -0,0 +1,162 @@
+// textcache.cc
+//	Routines to share code pages between address spaces.  See
+//	textcache.h.
+//
+//	With VM, the frames are given and taken through the core map,
+//	whose lock the callers of Lookup and Release hold: a frame shared
+//	by several address spaces is never evicted, and a frame used by
+//	a single one is forgotten when it is (see AddrSpace::PageOut).
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifdef CHANGED
+
+#include "copyright.h"
+#include "system.h"
+#include "textcache.h"
+
+static int
+Hash(int sector, int page)
+{
+    return ((unsigned) sector * 31 + page) % TextCacheBuckets;
+}
+
+//----------------------------------------------------------------------
+// TextCache::TextCache
+// 	Initially, no frame is cached.
+//----------------------------------------------------------------------
+
+TextCache::TextCache(int nFrames)
+  : numFrames(nFrames)
+{
+    sectorOf = new int[numFrames];
+    pageOf = new int[numFrames];
+    next = new int[numFrames];
+    for (int i = 0; i < numFrames; i++)
+	sectorOf[i] = -1;
+    for (int i = 0; i < TextCacheBuckets; i++)
+	bucket[i] = -1;
+    numCached = 0;
+    lock = new Lock("text cache lock");
+}
+
+TextCache::~TextCache()
+{
+    delete [] sectorOf;
+    delete [] pageOf;
+    delete [] next;
+    delete lock;
+}
+
+//----------------------------------------------------------------------
+// TextCache::Lookup
+// 	Find "page" of the executable at "sector", and count the caller
+//	as one more user of its frame.
+//----------------------------------------------------------------------
+
+int
+TextCache::Lookup(int sector, int page)
+{
+    lock->Acquire();
+    int frame = bucket[Hash(sector, page)];
+    while (frame >= 0 && (sectorOf[frame] != sector || pageOf[frame] != page))
+	frame = next[frame];
+    if (frame >= 0) {
+#ifdef VM
+	coreMap->ShareFrame(frame);
+#else
+	frameProvider->ShareFrame(frame);
+#endif
+	DEBUG('a', "Text page %d of sector %d found in frame %d\n",
+	      page, sector, frame);
+    }
+    lock->Release();
+    return frame;
+}
+
+//----------------------------------------------------------------------
+// TextCache::Insert
+// 	Record that "frame", just loaded by its only user, holds "page"
+//	of the executable at "sector".  If another address space cached
+//	the same page meanwhile, keep that one: "frame" stays private.
+//----------------------------------------------------------------------
+
+void
+TextCache::Insert(int sector, int page, int frame)
+{
+    int h = Hash(sector, page);
+
+    lock->Acquire();
+    for (int f = bucket[h]; f >= 0; f = next[f])
+	if (sectorOf[f] == sector && pageOf[f] == page) {
+	    lock->Release();
+	    return;
+	}
+    sectorOf[frame] = sector;
+    pageOf[frame] = page;
+    next[frame] = bucket[h];
+    bucket[h] = frame;
+    numCached++;
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// TextCache::Release
+// 	Drop one reference to "frame", and forget it if nobody else maps
+//	it: it is about to be reused.
+//----------------------------------------------------------------------
+
+void
+TextCache::Release(int frame)
+{
+    lock->Acquire();
+    if (sectorOf[frame] >= 0 && frameProvider->FrameRefCount(frame) == 1)
+	Unlink(frame);
+#ifdef VM
+    coreMap->ReleaseFrame(frame);
+#else
+    frameProvider->ReleaseFrame(frame);
+#endif
+    lock->Release();
+}
+
+void
+TextCache::Forget(int frame)
+{
+    lock->Acquire();
+    if (sectorOf[frame] >= 0)
+	Unlink(frame);
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// TextCache::Purge
+// 	Forget all the pages of the executable at "sector".  The frames
+//	are not released: the address spaces mapping them still do.
+//----------------------------------------------------------------------
+
+void
+TextCache::Purge(int sector)
+{
+    lock->Acquire();
+    for (int frame = 0; numCached > 0 && frame < numFrames; frame++)
+	if (sectorOf[frame] == sector)
+	    Unlink(frame);
+    lock->Release();
+}
+
+void
+TextCache::Unlink(int frame)
+{
+    int *link = &bucket[Hash(sectorOf[frame], pageOf[frame])];
+
+    while (*link != frame)
+	link = &next[*link];
+    *link = next[frame];
+    sectorOf[frame] = -1;
+    numCached--;
+}
+
+#endif // CHANGED
@@ -0,0 +1,63 @@
+// textcache.h
+//	Data structures to share the code pages of an executable between
+//	all the address spaces running it.
+//
+//	The text cache remembers which frame holds page "page" of the
+//	executable whose file header is at sector "sector".  Only pages
+//	made entirely of code are cached: they are never written to, so
+//	they can be mapped read-only into every address space that needs
+//	them, instead of being read from the file again.  A frame stays
+//	in the cache as long as some address space maps it.
+//
+//	Writing to or removing an executable purges its pages from the
+//	cache: the address spaces still using them keep the old code,
+//	new ones load the new one.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifdef CHANGED
+
+#ifndef TEXTCACHE_H
+#define TEXTCACHE_H
+
+#include "copyright.h"
+#include "synch.h"
+
+#define TextCacheBuckets	64	// size of the hash table
+
+class TextCache {
+  public:
+    TextCache(int numFrames);
+    ~TextCache();
+
+    int Lookup(int sector, int page);
+				// Return the frame holding "page" of the
+				// executable at "sector", with one more
+				// user, or -1 if it is not cached
+    void Insert(int sector, int page, int frame);
+				// "frame" now holds "page" of the
+				// executable at "sector"
+    void Release(int frame);	// An address space no longer maps
+				// "frame": free it if it was the last one
+    void Forget(int frame);	// "frame" is being taken back (VM)
+    void Purge(int sector);	// The executable at "sector" is being
+				// modified or removed
+
+  private:
+    void Unlink(int frame);	// Remove "frame" from its hash chain;
+				// lock held
+
+    int numFrames;
+    int *sectorOf;		// executable cached in each frame, or -1
+    int *pageOf;		// its page held in the frame
+    int *next;			// next frame in the same hash chain, or -1
+    int bucket[TextCacheBuckets];	// first frame of each chain, or -1
+    int numCached;		// frames in the cache
+    Lock *lock;
+};
+
+#endif // TEXTCACHE_H
+
+#endif // CHANGED
@@ -0,0 +1,122 @@
+// usercopy.cc
+//	Bulk copies between the kernel and user memory.  See usercopy.h.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifdef CHANGED
+
+#include "copyright.h"
+#include "system.h"
+#include "usercopy.h"
+
+//----------------------------------------------------------------------
+// UserSpan
+// 	Translate user address "addr" for an access of at most "size"
+//	bytes.  Return a pointer into mainMemory, and set "*span" to the
+//	number of bytes that can be accessed from it without crossing
+//	the page boundary.  Return NULL if the page cannot be accessed.
+//
+//	Going through Machine::Translate keeps the use and dirty bits of
+//	the page table up to date.  Pages not loaded yet are brought in,
+//	and shared copy-on-write pages are copied, as the user program
+//	itself would have done by faulting.
+//----------------------------------------------------------------------
+
+static char *
+UserSpan(int addr, int size, bool writing, int *span)
+{
+    int physAddr;
+    ExceptionType exception;
+
+    exception = machine->Translate(addr, &physAddr, 1, writing);
+    if (exception == PageFaultException
+	&& currentThread->space->PageIn((unsigned) addr / PageSize))
+	exception = machine->Translate(addr, &physAddr, 1, writing);
+    if (exception == ReadOnlyException
+	&& currentThread->space->CopyOnWrite((unsigned) addr / PageSize))
+	exception = machine->Translate(addr, &physAddr, 1, writing);
+    if (exception != NoException)
+	return NULL;
+    *span = PageSize - (unsigned) addr % PageSize;
+    if (*span > size)
+	*span = size;
+    return &machine->mainMemory[physAddr];
+}
+
+//----------------------------------------------------------------------
+// CopyFromUser
+// 	Copy "size" bytes from user address "from" to "to".
+//----------------------------------------------------------------------
+
+int
+CopyFromUser(int from, char *to, int size)
+{
+    int done = 0, span;
+
+    while (done < size) {
+	char *host = UserSpan(from + done, size - done, FALSE, &span);
+	if (host == NULL)
+	    break;
+	memcpy(to + done, host, span);
+	done += span;
+    }
+    return done;
+}
+
+//----------------------------------------------------------------------
+// CopyToUser
+// 	Copy "size" bytes from "from" to user address "to".  Since the
+//	copy bypasses WriteMem, drop the predecoded instructions of the
+//	frames written to.
+//----------------------------------------------------------------------
+
+int
+CopyToUser(const char *from, int to, int size)
+{
+    int done = 0, span;
+
+    while (done < size) {
+	char *host = UserSpan(to + done, size - done, TRUE, &span);
+	if (host == NULL)
+	    break;
+	memcpy(host, from + done, span);
+	machine->InvalidateDecodedPage((host - machine->mainMemory) / PageSize);
+	done += span;
+    }
+    return done;
+}
+
+//----------------------------------------------------------------------
+// StrnCopyFromUser
+// 	Copy the string at user address "from" into "to", truncating it
+//	to "size" - 1 characters.  The copy also stops, without error,
+//	at the first address that cannot be translated.
+//----------------------------------------------------------------------
+
+int
+StrnCopyFromUser(int from, char *to, int size)
+{
+    int len = 0, span;
+
+    if (size <= 0)
+	return 0;
+    while (len < size - 1) {
+	char *host = UserSpan(from + len, size - 1 - len, FALSE, &span);
+	if (host == NULL)
+	    break;
+	char *end = (char *) memchr(host, '\0', span);
+	if (end != NULL) {
+	    memcpy(to + len, host, end - host);
+	    len += end - host;
+	    break;
+	}
+	memcpy(to + len, host, span);
+	len += span;
+    }
+    to[len] = '\0';
+    return len;
+}
+
+#endif // CHANGED
@@ -0,0 +1,33 @@
+// usercopy.h
+//	Kernel routines to move data between the kernel and the address
+//	space of the current user program.
+//
+//	They translate each virtual page once and copy the whole span of
+//	the buffer lying in it with memcpy, instead of going through
+//	ReadMem or WriteMem for every byte or word.  Kernel accesses never
+//	raise exceptions: a copy simply stops at the first address that
+//	cannot be translated, and the number of bytes moved is returned.
+
+#ifdef CHANGED
+
+#ifndef USERCOPY_H
+#define USERCOPY_H
+
+#include "copyright.h"
+
+// Copy "size" bytes from user address "from" into the kernel buffer
+// "to".  Return the number of bytes copied.
+int CopyFromUser(int from, char *to, int size);
+
+// Copy "size" bytes from the kernel buffer "from" to user address
+// "to".  Return the number of bytes copied.
+int CopyToUser(const char *from, int to, int size);
+
+// Copy the string at user address "from" into "to", which can hold
+// "size" bytes: at most size - 1 characters are copied, and "to" is
+// always null-terminated.  Return the length of the copied string.
+int StrnCopyFromUser(int from, char *to, int size);
+
+#endif // USERCOPY_H
+
+#endif // CHANGED
@@ -26,8 +26,7 @@ int do_UserProcessCreate(char *filename, char *arg) {
   }
 
   AddrSpace *space;
-  space = new AddrSpace(executable);  
-  delete executable;
+  space = new AddrSpace(executable);  // keeps executable open
 
   Thread *newThread = new Thread(filename);
   newThread->space = space;
@@ -51,6 +50,55 @@ int do_UserProcessCreate(char *filename, char *arg) {
 }
 
 
+//----------------------------------------------------------------------
+// StartForkedProcess
+//      First code run by the thread of a process created by
+//      do_UserProcessFork: resume the user program where its parent
+//      made the system call, with 0 as the result.
+//----------------------------------------------------------------------
+
+static void StartForkedProcess(int dummy) {
+
+  currentThread->RestoreUserState();
+  currentThread->space->RestoreState();
+
+  machine->WriteRegister(2, 0);
+  int pc = machine->ReadRegister(PCReg);
+  machine->WriteRegister(PrevPCReg, pc);
+  pc = machine->ReadRegister(NextPCReg);
+  machine->WriteRegister(PCReg, pc);
+  machine->WriteRegister(NextPCReg, pc + 4);
+
+  machine->Run();
+}
+
+//----------------------------------------------------------------------
+// do_UserProcessFork
+//      Create a new process running a copy-on-write duplicate of the
+//      address space of the calling thread, which becomes the main
+//      thread of the child.  Return the PID of the child to the parent.
+//----------------------------------------------------------------------
+
+int do_UserProcessFork() {
+
+  AddrSpace *space = new AddrSpace(currentThread->space);
+
+  Thread *newThread = new Thread("forked process");
+  newThread->space = space;
+  newThread->SetPID();
+  newThread->SaveUserState();   // the registers of the system call
+
+  machine->IncrementProcesses();
+  machine->activeProcess->AppendTraverse(NULL, newThread->GetPID());
+
+  ThreadParam *threadParam = new ThreadParam();
+  threadParam->isProcess = true;
+
+  newThread->Fork(StartForkedProcess, (int) threadParam);
+
+  return newThread->GetPID();
+}
+
 void do_UserProcessExit() {
 
   currentThread->space->decreaseUserThreads();
@@ -78,6 +126,9 @@ void do_UserProcessExit() {
     machine->activeProcessLocks->PrintContent();
   }
   
+  // no thread of the process runs user code any more
+  currentThread->space->ReleasePages();
+
   //Exit or terminate machine :)
   if (machine->numberOfProcesses == 0) {
     interrupt->Halt();
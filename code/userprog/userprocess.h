@@ -3,4 +3,5 @@
 int do_UserProcessCreate(char *filename, char *arg);
 void do_UserProcessExit();
 int do_UserProcessJoin(int pid);
+int do_UserProcessFork();
 #endif
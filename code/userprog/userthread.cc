@@ -33,9 +33,8 @@ static void StartUserThread(int data) {
   machine->WriteRegister(PCReg, threadParam->function);
   machine->WriteRegister(NextPCReg, threadParam->function + 4);
   
-  // Set the stack. Make sure it's a positive number (at leat 3*PageSize pages) by incrementing 1
-  // The reason to do so is that our bitmap starts from 0
-  currentThread->space->MultiThreadSetStackPointer((3 * PageSize) * (currentThread->GetStackLocation() + 1));
+  // Set the stack, in the region reserved for this location
+  currentThread->space->SetThreadStackPointer(currentThread->GetStackLocation());
 
   machine->Run();
 }
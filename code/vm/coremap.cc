@@ -0,0 +1,157 @@
+// coremap.cc
+//	Routines to allocate frames and replace pages.  See coremap.h.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifdef CHANGED
+
+#include "copyright.h"
+#include "system.h"
+#include "coremap.h"
+#include "addrspace.h"
+
+#include <strings.h>		/* for bzero */
+
+//----------------------------------------------------------------------
+// CoreMap::CoreMap
+// 	Initially, no frame holds any user page.
+//----------------------------------------------------------------------
+
+CoreMap::CoreMap(int nFrames)
+  : numFrames(nFrames)
+{
+    frames = new CoreMapEntry[numFrames];
+    for (int i = 0; i < numFrames; i++)
+	frames[i].owner = NULL;
+    hand = 0;
+    lock = new Lock("core map lock");
+}
+
+CoreMap::~CoreMap()
+{
+    delete [] frames;
+    delete lock;
+}
+
+void
+CoreMap::Acquire()
+{
+    lock->Acquire();
+}
+
+void
+CoreMap::Release()
+{
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// CoreMap::AllocateFrame
+// 	Find a frame for page "vpn" of "space", whose translation is
+//	"entry": a free one if the FrameProvider still has some,
+//	otherwise one whose page the clock algorithm evicts.
+//----------------------------------------------------------------------
+
+int
+CoreMap::AllocateFrame(AddrSpace *space, unsigned int vpn,
+		       TranslationEntry *entry)
+{
+    ASSERT(lock->isHeldByCurrentThread());
+
+    int frame = frameProvider->GetEmptyFrame();
+    if (frame < 0) {
+	frame = FindVictim();
+	if (frame < 0)
+	    return -1;
+	CoreMapEntry *victim = &frames[frame];
+	DEBUG('a', "Evicting page %d of %p from frame %d\n", victim->vpn,
+	      victim->owner, frame);
+	victim->owner->PageOut(victim->vpn);
+	bzero(&machine->mainMemory[frame * PageSize], PageSize);
+	machine->InvalidateDecodedPage(frame);
+    }
+    frames[frame].owner = space;
+    frames[frame].vpn = vpn;
+    frames[frame].entry = entry;
+    return frame;
+}
+
+//----------------------------------------------------------------------
+// CoreMap::ReleaseFrame
+// 	Called by the owner of "frame" when it frees its memory, with the
+//	lock held so that the page cannot be chosen as a victim meanwhile.
+//----------------------------------------------------------------------
+
+void
+CoreMap::ReleaseFrame(int frame)
+{
+    ASSERT(lock->isHeldByCurrentThread());
+    frames[frame].owner = NULL;
+    frameProvider->ReleaseFrame(frame);
+}
+
+//----------------------------------------------------------------------
+// CoreMap::ShareFrame
+// 	"frame" is now mapped by one more address space.  It has no
+//	single owner to page it out any more, so the clock skips it.
+//----------------------------------------------------------------------
+
+void
+CoreMap::ShareFrame(int frame)
+{
+    ASSERT(lock->isHeldByCurrentThread());
+    frames[frame].owner = NULL;
+    frameProvider->ShareFrame(frame);
+}
+
+//----------------------------------------------------------------------
+// CoreMap::AdoptFrame
+// 	The other users of shared "frame" have released it: page "vpn"
+//	of "space" owns it alone, and it may be evicted again.
+//----------------------------------------------------------------------
+
+void
+CoreMap::AdoptFrame(int frame, AddrSpace *space, unsigned int vpn,
+		    TranslationEntry *entry)
+{
+    ASSERT(lock->isHeldByCurrentThread());
+    ASSERT(frameProvider->FrameRefCount(frame) == 1);
+    frames[frame].owner = space;
+    frames[frame].vpn = vpn;
+    frames[frame].entry = entry;
+}
+
+//----------------------------------------------------------------------
+// CoreMap::FindVictim
+// 	Advance the clock hand to the first user page whose use bit is
+//	clear, clearing the use bits on the way.  Two turns are enough
+//	to find one, unless no frame holds a user page at all.
+//
+//	The use bits of the running address space may still be in the
+//	TLB, so flush it first; and the software MMU must forget the
+//	pages whose bit is cleared, so that their next reference sets
+//	it again.
+//----------------------------------------------------------------------
+
+int
+CoreMap::FindVictim()
+{
+    machine->FlushTLB();
+    for (int i = 0; i < 2 * numFrames; i++) {
+	int frame = hand;
+	hand = (hand + 1) % numFrames;
+	if (frames[frame].owner == NULL)
+	    continue;
+	if (!frames[frame].entry->use) {
+	    machine->MappingChanged();
+	    return frame;
+	}
+	frames[frame].entry->use = FALSE;
+    }
+    machine->MappingChanged();
+    return -1;
+}
+
+#endif // CHANGED
@@ -0,0 +1,75 @@
+// coremap.h
+//	Data structures for page replacement.
+//
+//	The core map records, for each physical frame, which virtual
+//	page of which address space it holds.  When no frame is free,
+//	one is taken back with the clock (second chance) algorithm: the
+//	hand sweeps the frames, clearing the use bits that Translate
+//	sets, and stops on the first page not referenced since its last
+//	visit.  That page is written to the swap file if it is dirty.
+//
+//	All page-ins and page-outs are serialized by the core map lock,
+//	so a frame never changes hands while it is being filled or
+//	written out.
+//
+//	A frame shared by copy-on-write duplicates has no owner: it is
+//	never evicted, until one of its users takes it over again
+//	(AdoptFrame) when the others are gone.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifdef CHANGED
+
+#ifndef COREMAP_H
+#define COREMAP_H
+
+#include "copyright.h"
+#include "translate.h"
+#include "synch.h"
+
+class AddrSpace;
+
+class CoreMapEntry {
+  public:
+    AddrSpace *owner;		// address space using the frame, or NULL
+    unsigned int vpn;		// its virtual page in that space
+    TranslationEntry *entry;	// the page table entry mapping it
+};
+
+class CoreMap {
+  public:
+    CoreMap(int numFrames);
+    ~CoreMap();
+
+    void Acquire();		// Take and give back the core map lock,
+    void Release();		// around any page-in
+
+    int AllocateFrame(AddrSpace *space, unsigned int vpn,
+		      TranslationEntry *entry);
+				// Return a zeroed frame for page "vpn" of
+				// "space", evicting a page if needed, or
+				// -1 if none can be found.  Lock held.
+    void ReleaseFrame(int frame);
+				// "frame" is no longer used by its owner.
+				// Lock held.
+    void ShareFrame(int frame);	// "frame" gets one more user, and can
+				// no longer be evicted.  Lock held.
+    void AdoptFrame(int frame, AddrSpace *space, unsigned int vpn,
+		    TranslationEntry *entry);
+				// "space", now the only user of shared
+				// "frame", owns it again.  Lock held.
+
+  private:
+    int FindVictim();		// Run the clock; lock held
+
+    int numFrames;
+    CoreMapEntry *frames;	// one entry per physical frame
+    int hand;			// position of the clock hand
+    Lock *lock;
+};
+
+#endif // COREMAP_H
+
+#endif // CHANGED
@@ -0,0 +1,113 @@
+// swap.cc
+//	Routines to manage the swap file.  See swap.h.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifdef CHANGED
+
+#include "copyright.h"
+#include "system.h"
+#include "swap.h"
+
+//----------------------------------------------------------------------
+// SwapFile::SwapFile
+// 	Initialize the slot map.  The file itself is created by Open.
+//----------------------------------------------------------------------
+
+SwapFile::SwapFile()
+{
+    file = NULL;
+    slots = new BitMap(NumSwapPages);
+    lock = new Lock("swap lock");
+}
+
+//----------------------------------------------------------------------
+// SwapFile::~SwapFile
+//----------------------------------------------------------------------
+
+SwapFile::~SwapFile()
+{
+    if (file != NULL)
+	delete file;
+    delete slots;
+    delete lock;
+}
+
+//----------------------------------------------------------------------
+// SwapFile::Open
+// 	Create the swap file, replacing the one a previous run may have
+//	left, and write it once completely so that all its sectors are
+//	allocated.  Called with "lock" held.
+//----------------------------------------------------------------------
+
+void
+SwapFile::Open()
+{
+    char *zeros = new char[NumSwapPages * PageSize];
+
+    fileSystem->Remove(SwapFileName);
+    if (!fileSystem->Create(SwapFileName)
+	|| (file = fileSystem->Open(SwapFileName)) == NULL) {
+	printf("Unable to create the swap file\n");
+	ASSERT(FALSE);
+    }
+    memset(zeros, 0, NumSwapPages * PageSize);
+    if (file->WriteAt(zeros, NumSwapPages * PageSize, 0)
+	!= NumSwapPages * PageSize) {
+	printf("Not enough disk space for %d swap pages\n", NumSwapPages);
+	ASSERT(FALSE);
+    }
+    delete [] zeros;
+}
+
+//----------------------------------------------------------------------
+// SwapFile::AllocSlot
+// 	Return a free slot, or -1 if there is none.
+//----------------------------------------------------------------------
+
+int
+SwapFile::AllocSlot()
+{
+    lock->Acquire();
+    if (file == NULL)
+	Open();
+    int slot = slots->Find();
+    lock->Release();
+    return slot;
+}
+
+//----------------------------------------------------------------------
+// SwapFile::FreeSlot
+//----------------------------------------------------------------------
+
+void
+SwapFile::FreeSlot(int slot)
+{
+    lock->Acquire();
+    slots->Clear(slot);
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// SwapFile::ReadSlot, SwapFile::WriteSlot
+// 	Transfer one page between memory and an allocated slot.  The
+//	callers (AddrSpace) make sure nobody uses that slot meanwhile.
+//----------------------------------------------------------------------
+
+void
+SwapFile::ReadSlot(int slot, char *into)
+{
+    ASSERT(slots->Test(slot));
+    file->ReadAt(into, PageSize, slot * PageSize);
+}
+
+void
+SwapFile::WriteSlot(int slot, char *from)
+{
+    ASSERT(slots->Test(slot));
+    file->WriteAt(from, PageSize, slot * PageSize);
+}
+
+#endif // CHANGED
@@ -0,0 +1,50 @@
+// swap.h
+//	Data structures for the backing store of virtual memory.
+//
+//	Pages evicted from physical memory while dirty are written to a
+//	swap file of the Nachos file system, in fixed slots of one page.
+//	The file is created, and extended to its full size, the first
+//	time a slot is needed, so that writing a slot never allocates
+//	disk space.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifdef CHANGED
+
+#ifndef SWAP_H
+#define SWAP_H
+
+#include "copyright.h"
+#include "bitmap.h"
+#include "openfile.h"
+#include "synch.h"
+
+#define SwapFileName	"swap"
+#define NumSwapPages	512		// twice the physical memory
+
+class SwapFile {
+  public:
+    SwapFile();			// Nothing is created on disk yet
+    ~SwapFile();
+
+    int AllocSlot();		// Reserve a slot, -1 if the swap is full
+    void FreeSlot(int slot);	// Give a slot back
+
+    void ReadSlot(int slot, char *into);
+				// Read one page from "slot"
+    void WriteSlot(int slot, char *from);
+				// Write one page to "slot"
+
+  private:
+    void Open();		// Create the swap file, at first use
+
+    OpenFile *file;		// the swap file, or NULL if not created
+    BitMap *slots;		// which slots are in use
+    Lock *lock;			// protects "slots" and the creation
+};
+
+#endif // SWAP_H
+
+#endif // CHANGED